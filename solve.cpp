@@ -1,30 +1,203 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
 #include <string>
-#include <unordered_set>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "solver.h"
+
 using std::cout;
 using std::endl;
 using std::fstream;
 using std::iostream;
+using std::istringstream;
 using std::ofstream;
 using std::string;
-using std::unordered_set;
 using std::vector;
 
+namespace {
+
 enum Assignment { UNASSIGNED, BOMB, EMPTY };
 
-struct Domain {
-    bool canBeBomb = true;
-    bool canBeEmpty = true;
+// a tile belongs to 3 units and at most 8 numbered tiles
+constexpr int MAX_DEGREE = 3 + 8;
+
+// node budget of every uniqueness check the generator makes, which keeps big boards from stalling it
+constexpr size_t GENERATOR_CHECK_NODES = 20000;
+// layouts the generator samples for one puzzle before it takes the difficulty range to be out of reach
+constexpr size_t GENERATOR_ATTEMPTS = 10000;
+// requests one client of the server may have in flight before reading more of its requests waits
+constexpr size_t SERVER_WINDOW = 1024;
+
+// Fixed-width set of tiles, one bit per tile in row-major order. The word count is a compile-time constant,
+// so every loop over the words unrolls for each board size.
+template <int Words>
+struct Bitboard {
+    static constexpr int WORDS = Words;
+    uint64_t words[Words] = {};
+
+    // returns the bitboard with only the given bit set
+    static constexpr Bitboard bit(int index) {
+        Bitboard result;
+        result.words[index / 64] = uint64_t(1) << (index % 64);
+        return result;
+    }
+    // returns the bitboard with the lowest count bits set
+    static constexpr Bitboard first(int count) {
+        Bitboard result;
+        for (int word = 0; word < Words; ++word) {
+            int bits = count - 64 * word;
+            result.words[word] = bits >= 64 ? ~uint64_t(0) : bits > 0 ? (uint64_t(1) << bits) - 1 : 0;
+        }
+        return result;
+    }
+    constexpr bool test(int index) const {
+        return (words[index / 64] >> (index % 64)) & 1;
+    }
+    constexpr explicit operator bool() const {
+        uint64_t any = 0;
+        for (int word = 0; word < Words; ++word) any |= words[word];
+        return any != 0;
+    }
+    constexpr bool operator==(const Bitboard& other) const {
+        uint64_t difference = 0;
+        for (int word = 0; word < Words; ++word) difference |= words[word] ^ other.words[word];
+        return difference == 0;
+    }
+    constexpr Bitboard operator~() const {
+        Bitboard result;
+        for (int word = 0; word < Words; ++word) result.words[word] = ~words[word];
+        return result;
+    }
+    constexpr Bitboard& operator&=(const Bitboard& other) {
+        for (int word = 0; word < Words; ++word) words[word] &= other.words[word];
+        return *this;
+    }
+    constexpr Bitboard& operator|=(const Bitboard& other) {
+        for (int word = 0; word < Words; ++word) words[word] |= other.words[word];
+        return *this;
+    }
+    constexpr Bitboard& operator^=(const Bitboard& other) {
+        for (int word = 0; word < Words; ++word) words[word] ^= other.words[word];
+        return *this;
+    }
+    friend constexpr Bitboard operator&(Bitboard left, const Bitboard& right) {
+        return left &= right;
+    }
+    friend constexpr Bitboard operator|(Bitboard left, const Bitboard& right) {
+        return left |= right;
+    }
+    friend constexpr Bitboard operator^(Bitboard left, const Bitboard& right) {
+        return left ^= right;
+    }
+};
+
+// Board geometry: a GRID_SIZE x GRID_SIZE grid split into BOX_SIZE x BOX_SIZE boxes. Everything that depends
+// on the size of the board is a template on one of these, so each size gets its own bitboard width and
+// tables.
+template <int BoxSize>
+struct Geometry {
+    static constexpr int BOX_SIZE = BoxSize;
+    static constexpr int GRID_SIZE = BoxSize * BoxSize;
+    static constexpr int CELLS = GRID_SIZE * GRID_SIZE;
+    // rows, then columns, then boxes
+    static constexpr int UNITS = 3 * GRID_SIZE;
+    // 3 bombs per unit on the classic 9x9 board, the same density on bigger ones
+    static constexpr int DEFAULT_BOMBS_PER_UNIT = GRID_SIZE / 3;
+    using Bits = Bitboard<(CELLS + 63) / 64>;
+    static constexpr Bits ALL_TILES = Bits::first(CELLS);
+};
+
+// 128-bit Zobrist hash of the assignments, wide enough that distinct nodes never collide in practice
+using ZobristKey = unsigned __int128;
+
+// Running counts for one constraint (a unit, or the blank tiles around a numbered tile)
+struct ConstraintCounts {
+    uint8_t bombs = 0;
+    uint8_t empties = 0;
+    uint8_t unassigned = 0;
+};
+
+// How we represent the puzzle: every tile property is a bitboard so that the whole
+// state is a handful of words, plus constraint counts kept up to date on every assign and unassign.
+template <typename G>
+struct Puzzle {
+    using Bits = typename G::Bits;
+    Bits bombs;                  // tiles assigned BOMB
+    Bits empties;                // tiles assigned EMPTY (numbered tiles are always EMPTY)
+    Bits canBeBomb;              // domain: tile may still be a bomb
+    Bits canBeEmpty;             // domain: tile may still be empty
+    Bits numbered;               // tiles holding a number
+    uint8_t nums[G::CELLS] = {}; // the number on each tile, 0 for blank tiles
+    int bombsPerUnit = G::DEFAULT_BOMBS_PER_UNIT;
+    int emptysPerUnit = G::GRID_SIZE - G::DEFAULT_BOMBS_PER_UNIT;
+    ZobristKey hash = 0; // hash of bombs and empties on blank tiles, kept up to date by the trail
+    ConstraintCounts units[G::UNITS];
+    ConstraintCounts clues[G::CELLS]; // only meaningful for numbered tiles, counts their blank neighbours
+    // Degree of every blank tile and the tiles bucketed by degree, kept up to date with the counts above.
+    // Only the entries of unassigned tiles are meaningful.
+    uint8_t degrees[G::CELLS] = {};
+    Bits degreeBuckets[MAX_DEGREE + 1];
+};
+
+// The bitboards that change during search. Assignments only ever gain bits and domains only ever lose
+// them, so each trail entry records exactly the bits that flipped in one word of one field.
+enum TrailField { BOMBS, EMPTIES, CAN_BE_BOMB, CAN_BE_EMPTY };
+
+struct TrailEntry {
+    uint64_t bits = 0;
+    uint16_t word = 0;
+    uint8_t field = BOMBS;
 };
 
-// How we represent tiles and their information
-struct Tile {
-    int num = 0;
-    Domain domain;
-    Assignment assignment = UNASSIGNED;
+// Undo stack of every assignment and domain change made during search. A bit can only flip once while its
+// entry is on the trail, so the stack never holds more than one entry per bit of the four fields.
+template <typename G>
+struct Trail {
+    TrailEntry entries[4 * G::CELLS];
+    int size = 0;
+};
+
+// Tiles that were assigned during propagation and still need their units and numbered neighbours checked.
+// Every tile is assigned at most once, so it can never hold more than CELLS tiles.
+template <typename G>
+struct PropagationQueue {
+    int tiles[G::CELLS];
+    int head = 0;
+    int tail = 0;
 };
 
 struct Pair {
@@ -32,575 +205,3844 @@ struct Pair {
     int col = 0;
 };
 
-struct Node {
-    vector<vector<Tile>> puzzle;
+// Precomputed unit and adjacency tables, built at compile time. A tile's 8-neighbours are both the numbered
+// tiles that may constrain it and, for a numbered tile, the tiles it constrains.
+template <typename G>
+struct Masks {
+    typename G::Bits units[G::UNITS];
+    uint16_t tileUnits[G::CELLS][3] = {}; // the row, column and box unit of each tile
+    typename G::Bits neighbours[G::CELLS]; // the 8-neighbours of each tile
+    uint16_t neighbourList[G::CELLS][8] = {};
+    uint8_t neighbourCount[G::CELLS] = {};
+};
+
+#ifdef SOLVER_STATS
+// Per-phase counters and timers, only compiled in with -DSOLVER_STATS (make stats). Every thread counts into its
+// own copy, which gets merged into the totals once its work is done.
+struct PhaseStats {
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+};
+
+struct SolverStats {
+    PhaseStats select;    // selectUnassignedVariable
+    PhaseStats propagate; // forwardCheckUnit and forwardCheckNumberedTile
+    PhaseStats assign;    // assignTile, the save half of the trail
+    PhaseStats undo;      // undoTo, the restore half of the trail
+    PhaseStats hash;      // recording a node in the node table
+    PhaseStats io;        // reading puzzles and writing answers
+    PhaseStats subsets;   // subsetInference
+    uint64_t decisions = 0;
+    uint64_t backtracks = 0;        // branches whose subtree failed
+    uint64_t forcedAssignments = 0; // tiles assigned by propagation rather than by a decision
+    uint64_t subsetSettled = 0;     // values ruled out by the subset and overlap rules
+    uint64_t refutationProbes = 0;  // lookups in the table of refuted states
+    uint64_t refutationHits = 0;
+    uint64_t depth = 0;
+    uint64_t maxDepth = 0;
+    uint64_t unitFailures[3] = {}; // rows, columns, boxes
+    uint64_t clueFailures = 0;
+    uint64_t domainFailures = 0; // tiles left with no value
+    uint64_t conflicts = 0;      // CDCL engine
+};
+
+thread_local SolverStats solverStats;
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(PhaseStats& phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+        ++phase.calls;
+        phase.nanoseconds +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    PhaseStats& phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+class DepthTracker {
+public:
+    DepthTracker() {
+        solverStats.maxDepth = std::max(solverStats.maxDepth, ++solverStats.depth);
+    }
+    ~DepthTracker() {
+        --solverStats.depth;
+    }
+};
+
+// adds this thread's stats to the totals and starts it over
+void mergeStats();
+// writes the totals as JSON
+void writeStats(const string& statsPath);
+
+#define STATS_TIME(phase) PhaseTimer phaseTimer(solverStats.phase)
+#define STATS_DEPTH() DepthTracker depthTracker
+#define STATS_COUNT(counter) (++solverStats.counter)
+#define STATS_FAIL(counter) (++solverStats.counter, false)
+#define STATS_MERGE() mergeStats()
+#else
+#define STATS_TIME(phase) ((void)0)
+#define STATS_DEPTH() ((void)0)
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_FAIL(counter) false
+#define STATS_MERGE() ((void)0)
+#endif
+
+// How node counts are gathered. DISTINCT_NODES matches the number of different puzzle formations generated,
+// ALL_NODES counts every assignment the search makes and keeps no table at all.
+enum NodeCounting { DISTINCT_NODES, ALL_NODES };
+
+// Open-addressing set of node hashes with linear probing. A zero slot is empty, so a zero hash is tracked
+// separately.
+class NodeTable {
+public:
+    explicit NodeTable(NodeCounting counting = DISTINCT_NODES) : counting(counting) {}
+
+    void insert(ZobristKey key) {
+        STATS_TIME(hash);
+        if (counting == ALL_NODES) {
+            ++count;
+            return;
+        }
+        if (key == 0) {
+            count += !hasZero;
+            hasZero = true;
+            return;
+        }
+        // keep the load factor at or below 1/2
+        if (2 * (count + 1) > slots.size()) grow();
+        if (place(key)) ++count;
+    }
+    size_t size() const {
+        return count;
+    }
+    // empties the table but keeps its slots for the next search
+    void clear() {
+        if (count > 0) std::fill(slots.begin(), slots.end(), 0);
+        count = 0;
+        hasZero = false;
+    }
+
+private:
+    bool place(ZobristKey key) {
+        size_t mask = slots.size() - 1;
+        for (size_t slot = size_t(key) & mask;; slot = (slot + 1) & mask) {
+            if (slots[slot] == key) return false;
+            if (slots[slot] == 0) {
+                slots[slot] = key;
+                return true;
+            }
+        }
+    }
+    void grow() {
+        vector<ZobristKey> old = std::move(slots);
+        slots.assign(old.empty() ? 1024 : 2 * old.size(), 0);
+        for (ZobristKey key : old) {
+            if (key != 0) place(key);
+        }
+    }
+
+    NodeCounting counting;
+    vector<ZobristKey> slots;
+    size_t count = 0;
+    bool hasZero = false;
+};
+
+// Bounded set of refuted states, those the search has shown to have no solution, keyed by the hash of their
+// assignments and domains. Buckets of four entries fill a cache line each. A new state replaces the entry whose
+// refutation took the fewest nodes, so the most expensive refutations stay.
+class RefutationTable {
+public:
+    explicit RefutationTable(size_t bytes) {
+        size_t bucketCount = 1;
+        while (2 * bucketCount * sizeof(Bucket) <= bytes) bucketCount *= 2;
+        buckets.assign(bucketCount, Bucket());
+    }
+
+    bool contains(ZobristKey key) {
+        ++probes;
+        for (const Entry& entry : bucketOf(key).entries) {
+            if (entry.work > 0 && entry.check == uint64_t(key >> 64)) {
+                ++hits;
+                return true;
+            }
+        }
+        return false;
+    }
+    // work is the number of nodes it took to refute the state
+    void insert(ZobristKey key, size_t work) {
+        uint64_t check = uint64_t(key >> 64);
+        Entry* victim = nullptr;
+        for (Entry& entry : bucketOf(key).entries) {
+            // a state refuted again keeps its one entry, with the costlier of the two refutations
+            if (entry.work > 0 && entry.check == check) {
+                entry.work = std::max<uint64_t>(entry.work, work + 1);
+                return;
+            }
+            if (!victim || entry.work < victim->work) victim = &entry;
+        }
+        *victim = {check, work + 1};
+    }
+
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+
+private:
+    struct Entry {
+        uint64_t check = 0; // the high half of the key, the low half picks the bucket
+        uint64_t work = 0;  // one more than the nodes of the refutation, 0 for an empty entry
+    };
+    struct alignas(64) Bucket {
+        Entry entries[4];
+    };
+
+    Bucket& bucketOf(ZobristKey key) {
+        return buckets[uint64_t(key) & (buckets.size() - 1)];
+    }
+
+    vector<Bucket> buckets;
+};
+
+// Bump allocator over one block that is kept from search to search. reset() drops everything at once and only
+// grows the block when the next search needs more than any before it. Only for trivially destructible state,
+// which is never destroyed.
+class Arena {
+public:
+    void reset(size_t bytes) {
+        used = 0;
+        if (bytes <= capacity) return;
+        storage.reset(new char[bytes + ALIGNMENT]);
+        base = storage.get() + (ALIGNMENT - reinterpret_cast<uintptr_t>(storage.get()) % ALIGNMENT) % ALIGNMENT;
+        capacity = bytes;
+    }
+    // default-initialized, so big arrays without initializers are left as they are
+    template <typename T>
+    T* allocate() {
+        static_assert(std::is_trivially_destructible<T>::value && alignof(T) <= ALIGNMENT);
+        size_t start = (used + alignof(T) - 1) / alignof(T) * alignof(T);
+        used = start + sizeof(T);
+        return new (base + start) T;
+    }
+    // bytes to reset to for allocating one of each of the types
+    template <typename... T>
+    static constexpr size_t bytesFor() {
+        return ((sizeof(T) + ALIGNMENT) + ...);
+    }
+
+private:
+    static constexpr size_t ALIGNMENT = 64;
+
+    std::unique_ptr<char[]> storage;
+    char* base = nullptr;
+    size_t used = 0;
+    size_t capacity = 0;
+};
+
+#ifndef SOLVER_LIBRARY
+// Double-ended queue of subproblems owned by one worker of a parallel search. The owner takes from the back and
+// idle workers steal from the front.
+template <typename T>
+class WorkDeque {
+public:
+    void push(T item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        items.push_back(std::move(item));
+    }
+    bool pop(T& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        item = std::move(items.back());
+        items.pop_back();
+        return true;
+    }
+    bool steal(T& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<T> items;
+};
+
+// Queue of work for a pool of threads that wait for it. pop blocks until there is an item, or returns false once
+// the queue is closed and empty.
+template <typename T>
+class BlockingQueue {
+public:
+    void push(T item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push_back(std::move(item));
+        }
+        ready.notify_one();
+    }
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&]() { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<T> items;
+    bool closed = false;
+};
+#endif
+
+// Limits and strategy of one search. It gives up once the node table holds nodeLimit nodes, once the deadline has
+// passed or once another thread sets cancelled, and then unwinds without trying anything else. The members of a
+// portfolio each search with their own value order, tie-breaks and restarts.
+struct SearchControl {
+    using Clock = std::chrono::steady_clock;
+    size_t nodeLimit = SIZE_MAX;
+    Clock::time_point deadline = Clock::time_point::max();
+    const std::atomic<bool>* cancelled = nullptr;
+    bool bombFirst = false;         // try BOMB before EMPTY
+    uint64_t random = 0;            // tie-break generator state, 0 breaks ties by the first tile in row-major order
+    size_t restartLimit = SIZE_MAX; // decisions the current run may make before it starts over
+    size_t decisions = 0;           // decisions made in the current run
+    int subsetDepth = 0;            // search levels that run subsetInference, the root being the first, 0 for none
+    int depth = 0;                  // decisions on the current path
+    const uint8_t* phases = nullptr;    // the value to try first on each tile, 1 for BOMB, in place of bombFirst
+    RefutationTable* refuted = nullptr; // states known to have no solution, null to keep none
+    uint64_t refutationProbes = 0;      // lookups and hits in the tables of a portfolio's members
+    uint64_t refutationHits = 0;
+    size_t checks = 0;
+    bool gaveUp = false;
+    bool restart = false;
+
+    // true once the search has to unwind. The clock is only read every few calls.
+    bool expired(size_t nodeCount) {
+        if (gaveUp || restart) return true;
+        if (nodeCount >= nodeLimit || (cancelled && cancelled->load(std::memory_order_relaxed))) return gaveUp = true;
+        if (deadline != Clock::time_point::max() && ++checks % 64 == 0 && Clock::now() >= deadline) {
+            return gaveUp = true;
+        }
+        if (decisions >= restartLimit) return restart = true;
+        return false;
+    }
+};
+
+// xorshift64, returns the next number and advances a nonzero state
+inline uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// the Luby sequence 1 1 2 1 1 2 4 1 1 2 ..., counted from 1
+uint64_t luby(uint64_t index);
+
+// Search engines. BACKTRACKING is chronological backtracking with forward checking, CDCL learns a clause from
+// every conflict and jumps back to the decision that caused it.
+enum Engine { BACKTRACKING, CDCL };
+
+// Conflict-driven clause learning over constraints of the form "exactly count of these variables are true".
+// Cardinality constraints propagate from running counts of their true and false members and explain their
+// implications lazily, learned clauses propagate with two watched literals. A literal is 2 * variable for
+// true and 2 * variable + 1 for false. Decisions take the most active variable from a heap. The search restarts
+// on the Luby sequence, and a restart that finds more learned clauses than the limit deletes the worst half.
+class CdclSolver {
+public:
+    explicit CdclSolver(int variables)
+        : values(variables, -1), levels(variables, 0), reasons(variables, NO_REASON), trailPositions(variables, 0),
+          variableConstraints(variables), watches(2 * variables), activity(variables, 0), heapIndex(variables, -1),
+          phases(variables, 0), seen(variables, 0) {
+        for (int variable = 0; variable < variables; ++variable) heapInsert(variable);
+    }
+
+    // adds the constraint that exactly count of the variables are true
+    void addExactly(const vector<int>& variables, int count) {
+        for (int variable : variables) variableConstraints[variable].push_back(constraints.size());
+        constraints.push_back({variables, count});
+    }
+    // fixes a variable before solving
+    void fix(int variable, bool value) {
+        if (values[variable] == -1) assign(2 * variable + !value, NO_REASON);
+    }
+    // returns true when every constraint is satisfied. On success each variable has a value. Gives up, returning
+    // false, when the control expires.
+    bool solve(SearchControl* control = nullptr) {
+        vector<int> conflict;
+        // constraints without assigned members have not been looked at yet
+        for (size_t constraint = 0; constraint < constraints.size(); ++constraint) {
+            if (!propagateConstraint(constraint, conflict)) return false;
+        }
+        vector<int> learnt;
+        uint64_t run = 1;
+        uint64_t conflicts = 0; // since the last restart
+        while (true) {
+            if (!propagate(conflict)) {
+                STATS_COUNT(conflicts);
+                if (levelStarts.empty()) return false;
+                int backLevel = analyze(conflict, learnt);
+                backjump(backLevel);
+                learn(learnt);
+                increment /= ACTIVITY_DECAY;
+                ++conflicts;
+                continue;
+            }
+            if (trail.size() == values.size()) return true;
+            if (control && control->expired(decisionCount)) return false;
+            // a restart keeps the learned clauses, activities and phases, so the search picks up where they point
+            if (conflicts >= luby(run) * RESTART_CONFLICTS) {
+                ++run;
+                conflicts = 0;
+                backjump(0);
+                if (clauses.size() >= learnedLimit) reduceClauses();
+                continue;
+            }
+            decide();
+        }
+    }
+    bool value(int variable) const {
+        return values[variable] == 1;
+    }
+    size_t decisions() const {
+        return decisionCount;
+    }
+
+private:
+    struct Cardinality {
+        vector<int> variables;
+        int count = 0;
+        int trues = 0;
+        int falses = 0;
+    };
+
+    static constexpr int NO_REASON = -1;
+    static constexpr double ACTIVITY_DECAY = 0.95;
+    // conflicts per unit of the Luby sequence between restarts
+    static constexpr uint64_t RESTART_CONFLICTS = 100;
+    // learned clauses kept before the first reduction, the limit grows by a tenth with every one
+    static constexpr size_t LEARNED_LIMIT = 2000;
+
+    // 1 if the literal is true, 0 if false, -1 if unassigned
+    int literalValue(int literal) const {
+        int value = values[literal >> 1];
+        return value == -1 ? -1 : value ^ (literal & 1);
+    }
+    int level() const {
+        return levelStarts.size();
+    }
+    // reasons below the number of constraints are cardinality constraints, the rest are learned clauses
+    void assign(int literal, int reason) {
+        int variable = literal >> 1;
+        values[variable] = !(literal & 1);
+        levels[variable] = level();
+        reasons[variable] = reason;
+        trailPositions[variable] = trail.size();
+        trail.push_back(literal);
+        for (int constraint : variableConstraints[variable]) {
+            ++(values[variable] ? constraints[constraint].trues : constraints[constraint].falses);
+        }
+    }
+    bool propagate(vector<int>& conflict) {
+        while (head < trail.size()) {
+            int literal = trail[head++];
+            for (int constraint : variableConstraints[literal >> 1]) {
+                if (!propagateConstraint(constraint, conflict)) return false;
+            }
+            if (!propagateClauses(literal ^ 1, conflict)) return false;
+        }
+        return true;
+    }
+    bool propagateConstraint(int index, vector<int>& conflict) {
+        const Cardinality& constraint = constraints[index];
+        int size = constraint.variables.size();
+        // too many true members or too many false ones, every one of them is part of the conflict
+        if (constraint.trues > constraint.count || constraint.falses > size - constraint.count) {
+            int conflicting = constraint.trues > constraint.count;
+            conflict.clear();
+            for (int variable : constraint.variables) {
+                if (values[variable] == conflicting) conflict.push_back(2 * variable + conflicting);
+            }
+            return false;
+        }
+        if (constraint.trues + constraint.falses == size) return true;
+        // every remaining member is forced the same way
+        int forced = constraint.trues == constraint.count ? 0 : constraint.falses == size - constraint.count ? 1 : -1;
+        if (forced == -1) return true;
+        for (int variable : constraint.variables) {
+            if (values[variable] == -1) assign(2 * variable + !forced, index);
+        }
+        return true;
+    }
+    // visits the learned clauses watching a literal that just became false
+    bool propagateClauses(int falseLiteral, vector<int>& conflict) {
+        vector<int>& watching = watches[falseLiteral];
+        size_t kept = 0;
+        for (size_t next = 0; next < watching.size(); ++next) {
+            int index = watching[next];
+            vector<int>& clause = clauses[index];
+            if (clause[0] == falseLiteral) std::swap(clause[0], clause[1]);
+            bool moved = false;
+            if (literalValue(clause[0]) != 1) {
+                for (size_t other = 2; other < clause.size() && !moved; ++other) {
+                    if (literalValue(clause[other]) == 0) continue;
+                    std::swap(clause[1], clause[other]);
+                    watches[clause[1]].push_back(index);
+                    moved = true;
+                }
+            }
+            if (moved) continue;
+            watching[kept++] = index;
+            if (literalValue(clause[0]) == 1) continue;
+            if (literalValue(clause[0]) == 0) {
+                conflict = clause;
+                while (++next < watching.size()) watching[kept++] = watching[next];
+                watching.resize(kept);
+                return false;
+            }
+            assign(clause[0], constraints.size() + index);
+        }
+        watching.resize(kept);
+        return true;
+    }
+    // the false literals that forced a variable
+    void explain(int variable, vector<int>& literals) const {
+        literals.clear();
+        int reason = reasons[variable];
+        if (reason >= int(constraints.size())) {
+            const vector<int>& clause = clauses[reason - constraints.size()];
+            literals.assign(clause.begin() + 1, clause.end());
+            return;
+        }
+        // a member forced false was forced by the members that were already true, and the other way round
+        int cause = !values[variable];
+        for (int member : constraints[reason].variables) {
+            if (values[member] == cause && trailPositions[member] < trailPositions[variable]) {
+                literals.push_back(2 * member + cause);
+            }
+        }
+    }
+    // Learns the first unique implication point clause of a conflict. The asserting literal goes first and a
+    // literal of the level to jump back to second. Returns that level.
+    int analyze(const vector<int>& conflict, vector<int>& learnt) {
+        learnt.assign(1, 0);
+        vector<int> literals = conflict;
+        int pending = 0;
+        size_t position = trail.size();
+        while (true) {
+            for (int literal : literals) {
+                int variable = literal >> 1;
+                if (seen[variable] || levels[variable] == 0) continue;
+                seen[variable] = 1;
+                bump(variable);
+                if (levels[variable] == level())
+                    ++pending;
+                else
+                    learnt.push_back(literal);
+            }
+            while (!seen[trail[--position] >> 1]) {}
+            int variable = trail[position] >> 1;
+            seen[variable] = 0;
+            if (--pending == 0) {
+                learnt[0] = trail[position] ^ 1;
+                break;
+            }
+            explain(variable, literals);
+        }
+        int backLevel = 0;
+        for (size_t index = 1; index < learnt.size(); ++index) {
+            seen[learnt[index] >> 1] = 0;
+            if (levels[learnt[index] >> 1] > backLevel) {
+                backLevel = levels[learnt[index] >> 1];
+                std::swap(learnt[1], learnt[index]);
+            }
+        }
+        return backLevel;
+    }
+    void learn(const vector<int>& learnt) {
+        if (learnt.size() == 1) {
+            assign(learnt[0], NO_REASON);
+            return;
+        }
+        clauses.push_back(learnt);
+        glues.push_back(glue(learnt));
+        watches[learnt[0]].push_back(clauses.size() - 1);
+        watches[learnt[1]].push_back(clauses.size() - 1);
+        assign(learnt[0], constraints.size() + clauses.size() - 1);
+    }
+    // the number of decision levels among the literals of a clause. Clauses with few of them propagate often.
+    int glue(const vector<int>& clause) const {
+        vector<int> clauseLevels;
+        for (int literal : clause) clauseLevels.push_back(levels[literal >> 1]);
+        std::sort(clauseLevels.begin(), clauseLevels.end());
+        return std::unique(clauseLevels.begin(), clauseLevels.end()) - clauseLevels.begin();
+    }
+    // Deletes the half of the learned clauses with the highest glue, but never a clause of glue 2 or less, and
+    // watches the rest anew. Runs at level 0, where analyze never asks for a reason, so the level 0 assignments
+    // forced by learned clauses lose theirs.
+    void reduceClauses() {
+        vector<int> order(clauses.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return glues[a] < glues[b]; });
+        vector<vector<int>> kept;
+        vector<int> keptGlues;
+        for (size_t rank = 0; rank < order.size(); ++rank) {
+            int index = order[rank];
+            if (rank >= order.size() / 2 && glues[index] > 2) continue;
+            kept.push_back(std::move(clauses[index]));
+            keptGlues.push_back(glues[index]);
+        }
+        clauses = std::move(kept);
+        glues = std::move(keptGlues);
+        for (int literal : trail) {
+            if (reasons[literal >> 1] >= int(constraints.size())) reasons[literal >> 1] = NO_REASON;
+        }
+        for (vector<int>& watching : watches) watching.clear();
+        for (size_t index = 0; index < clauses.size(); ++index) {
+            watches[clauses[index][0]].push_back(index);
+            watches[clauses[index][1]].push_back(index);
+        }
+        learnedLimit += learnedLimit / 10;
+    }
+    // unassigns everything above the given level
+    void backjump(int backLevel) {
+        if (backLevel >= level()) return;
+        for (size_t index = trail.size(); index-- > size_t(levelStarts[backLevel]);) {
+            int variable = trail[index] >> 1;
+            phases[variable] = values[variable];
+            for (int constraint : variableConstraints[variable]) {
+                --(values[variable] ? constraints[constraint].trues : constraints[constraint].falses);
+            }
+            values[variable] = -1;
+            heapInsert(variable);
+        }
+        trail.resize(levelStarts[backLevel]);
+        levelStarts.resize(backLevel);
+        head = trail.size();
+    }
+    // Branches on the most active unassigned variable, with the value it last had. Assigned variables only leave
+    // the heap once they reach its top.
+    void decide() {
+        int best = heapPop();
+        while (values[best] != -1) best = heapPop();
+        ++decisionCount;
+        levelStarts.push_back(trail.size());
+        assign(2 * best + !phases[best], NO_REASON);
+    }
+    void bump(int variable) {
+        activity[variable] += increment;
+        if (heapIndex[variable] != -1) heapUp(heapIndex[variable]);
+        if (activity[variable] < 1e100) return;
+        for (double& score : activity) score *= 1e-100;
+        increment *= 1e-100;
+    }
+    // true if variable a goes before b: more active, or as active and lower
+    bool before(int a, int b) const {
+        return activity[a] > activity[b] || (activity[a] == activity[b] && a < b);
+    }
+    void heapInsert(int variable) {
+        if (heapIndex[variable] != -1) return;
+        heap.push_back(variable);
+        heapUp(heap.size() - 1);
+    }
+    int heapPop() {
+        int top = heap[0];
+        heapIndex[top] = -1;
+        int last = heap.back();
+        heap.pop_back();
+        if (!heap.empty()) {
+            heap[0] = last;
+            heapDown(0);
+        }
+        return top;
+    }
+    void heapUp(int position) {
+        int variable = heap[position];
+        while (position > 0 && before(variable, heap[(position - 1) / 2])) {
+            heap[position] = heap[(position - 1) / 2];
+            heapIndex[heap[position]] = position;
+            position = (position - 1) / 2;
+        }
+        heap[position] = variable;
+        heapIndex[variable] = position;
+    }
+    void heapDown(int position) {
+        int variable = heap[position];
+        int size = heap.size();
+        while (2 * position + 1 < size) {
+            int child = 2 * position + 1;
+            if (child + 1 < size && before(heap[child + 1], heap[child])) ++child;
+            if (!before(heap[child], variable)) break;
+            heap[position] = heap[child];
+            heapIndex[heap[position]] = position;
+            position = child;
+        }
+        heap[position] = variable;
+        heapIndex[variable] = position;
+    }
+
+    vector<int8_t> values; // -1 while unassigned
+    vector<int> levels;
+    vector<int> reasons;
+    vector<int> trailPositions;
+    vector<Cardinality> constraints;
+    vector<vector<int>> variableConstraints;
+    vector<vector<int>> clauses;
+    vector<int> glues;           // of each learned clause
+    size_t learnedLimit = LEARNED_LIMIT;
+    vector<vector<int>> watches; // learned clauses by watched literal
+    vector<int> trail;
+    vector<int> levelStarts; // trail size at each decision
+    size_t head = 0;         // next trail entry to propagate
+    vector<double> activity;
+    double increment = 1;
+    vector<int> heap;      // every unassigned variable and some assigned ones, most active first
+    vector<int> heapIndex; // position of each variable in the heap, -1 when not in it
+    vector<int8_t> phases; // value each variable had when it was last unassigned
+    vector<int8_t> seen;
+    size_t decisionCount = 0;
+};
+
+// How answers are written. TEXT_OUTPUT is the goal depth, node count and grid of output.txt, BINARY_OUTPUT packs
+// each answer into a fixed-size record, see packAnswer.
+enum OutputFormat { TEXT_OUTPUT, BINARY_OUTPUT };
+
+// Solutions seen by a counting search, which stops once there are cap of them
+template <typename G>
+struct SolutionCount {
+    size_t cap = 1;
+    size_t count = 0;
+    Puzzle<G> first; // the first solution found
+};
+
+#ifndef SOLVER_LIBRARY
+// Puzzles a lockstep batch solves side by side, as many as fill a 512-bit vector of words
+constexpr int LANES = 8;
+
+// One word of a bitboard for every lane. GCC turns the operators on it into AVX-512 or AVX2 instructions when the
+// build targets them and into a loop over the lanes otherwise. Comparisons give -1 in the lanes where they hold.
+using LaneWord = uint64_t __attribute__((vector_size(8 * LANES)));
+
+// The boards of a lockstep batch. Word w of a field holds word w of that bitboard for every lane, so one vector
+// operation updates all the puzzles at once. Numbers are bit sliced: bit b of the number on a tile is that tile's
+// bit in slice b.
+template <typename G>
+struct LaneBoard {
+    static constexpr int WORDS = G::Bits::WORDS;
+    LaneWord bombs[WORDS];
+    LaneWord empties[WORDS];
+    LaneWord canBeBomb[WORDS];
+    LaneWord canBeEmpty[WORDS];
+    LaneWord numbered[WORDS];
+    LaneWord nums[4][WORDS];      // the number on each numbered tile
+    LaneWord emptyCaps[4][WORDS]; // the blank neighbours of each numbered tile that may be empty
+};
+
+// One decision of a lane's search. A lane keeps a copy of its board at every decision instead of a trail.
+template <typename G>
+struct LaneFrame {
+    typename G::Bits bombs;
+    typename G::Bits empties;
+    typename G::Bits canBeBomb;
+    typename G::Bits canBeEmpty;
+    ZobristKey hash = 0; // of the board before the decision
+    int tile = 0;
+    bool triedBomb = false; // EMPTY is always tried first
+};
+
+// The search running in one lane
+template <typename G>
+struct LaneSearch {
+    explicit LaneSearch(NodeCounting counting) : frames(G::CELLS), nodes(counting) {}
+
+    size_t index = SIZE_MAX; // the puzzle in the lane, SIZE_MAX once there are none left
+    ZobristKey hash = 0;
+    int depth = 0;
+    vector<LaneFrame<G>> frames;
+    NodeTable nodes;
+};
+#endif
+
+// A puzzle loaded into a Solver for editing. The tiles hold their values and pins as edited, and root holds a state
+// that follows from them: the inference of the last search, which stays sound for as long as edits only add
+// constraints.
+template <typename G>
+struct EditSession {
+    uint8_t values[G::CELLS];   // 0 for a blank tile, 1-8 for a numbered one
+    uint8_t pins[G::CELLS];     // 0 for a free tile, 1 for one pinned as a bomb, 2 for one pinned as empty
+    uint8_t solution[G::CELLS]; // the last solution found, 1 for a bomb
+    bool hasSolution = false;
+    int status = SOLVER_INVALID;
+    bool rootValid = false;
+    Puzzle<G> root;
+    Puzzle<G> puzzle; // the state being searched
+    Trail<G> trail;
+};
+
+#ifndef SOLVER_LIBRARY
+// Options from the command line
+struct Options {
+    NodeCounting counting = DISTINCT_NODES;
+    Engine engine = BACKTRACKING;
+    int bombsPerUnit = 0;     // 0 picks the default for the grid size
+    bool batch = false;       // solve every puzzle in a multi-puzzle file or a directory
+    bool parallel = false;    // split the search of a single puzzle across the threads
+    int threads = 0;          // worker threads for batch and parallel mode, 0 uses one per core
+    size_t solutionCap = 0;   // count solutions up to this many, 0 stops at the first one
+    bool generate = false;    // write new puzzles to stdout instead of solving
+    size_t puzzleCount = 0;   // puzzles to generate, 0 keeps going until stopped
+    int gridSize = 9;         // size of the generated puzzles
+    size_t minDifficulty = 0; // fewest nodes the solver may take on a generated puzzle
+    size_t maxDifficulty = SIZE_MAX;
+    uint64_t seed = 0x5eed;
+    bool bench = false;       // time the solver over one or more corpora
+    int warmup = 1;           // untimed passes over each corpus before the trials
+    int trials = 5;           // timed passes over each corpus
+    string resultsPath = "bench_results.json";
+    bool stats = false;       // write per-phase counters and timers, needs a SOLVER_STATS build
+    string statsPath = "stats.json";
+    OutputFormat format = TEXT_OUTPUT;
+    string outputPath = "output.txt"; // - writes the answers to stdout
+    bool serve = false;               // stay resident and answer puzzles one line at a time
+    string socketPath;                // Unix socket to serve on, empty serves stdin and stdout
+    size_t cacheEntries = 0;          // answers the server keeps for repeated and symmetric puzzles, 0 keeps none
+    size_t nodeBudget = 0;            // nodes a solve may generate before it gives up, 0 for no limit
+    int deadlineMs = 0;               // milliseconds a solve may take before it gives up, 0 for no limit
+    bool portfolio = false;           // race differently configured searches of a single puzzle
+    bool lockstep = false;            // solve batches LANES puzzles at a time per thread, pays off in a release build
+    int subsetDepth = 0;              // search levels that run subsetInference, the root being the first, 0 for none
+    size_t refutationBytes = 0;       // memory for each restarting portfolio member's refuted states, 0 for none
+    string filePath;
+};
+
+// What solving one puzzle produced
+struct SolveResult {
+    string answer; // the record written for the puzzle, in the output format of the options
+    size_t nodes = 0;
+    bool solved = false;
+    bool gaveUp = false; // a limit ran out before the search finished
+};
+
+// One puzzle decoded from the input, before it is turned into bitboards
+struct PuzzleInput {
+    vector<uint8_t> values;
+    int gridSize = 0;
+};
+
+// Buffered output to a file or stdout. Answers are copied into one large buffer that only gets written out when it
+// fills up or the writer is flushed, so nothing is flushed per line.
+class ResultWriter {
+public:
+    explicit ResultWriter(const string& outputPath) : buffer(BUFFER_SIZE) {
+        fd = outputPath == "-" ? STDOUT_FILENO : open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    ~ResultWriter() {
+        flush();
+        if (fd > STDOUT_FILENO) close(fd);
+    }
+    ResultWriter(const ResultWriter&) = delete;
+    ResultWriter& operator=(const ResultWriter&) = delete;
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+    // true once a write has failed, everything after it is dropped
+    bool failed() const {
+        return writeFailed;
+    }
+    void write(const string& data) {
+        if (used + data.size() > buffer.size()) flush();
+        // a record bigger than the whole buffer goes straight out
+        if (data.size() > buffer.size()) return writeAll(data.data(), data.size());
+        std::memcpy(buffer.data() + used, data.data(), data.size());
+        used += data.size();
+    }
+    void flush() {
+        STATS_TIME(io);
+        writeAll(buffer.data(), used);
+        used = 0;
+    }
+
+private:
+    static constexpr size_t BUFFER_SIZE = size_t(1) << 20;
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0 && isOpen() && !writeFailed) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) {
+                writeFailed = true;
+                return;
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    int fd = -1;
+    vector<char> buffer;
+    size_t used = 0;
+    bool writeFailed = false;
+};
+
+// Read-only view of a whole file through mmap, so that big corpora get parsed in place without being copied
+class MappedFile {
+public:
+    explicit MappedFile(const string& filePath) {
+        int fd = open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        opened = true;
+        struct stat info;
+        // an empty file cannot be mapped, it is simply open with no data
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = static_cast<const char*>(mapping);
+                length = info.st_size;
+                madvise(mapping, length, MADV_SEQUENTIAL);
+            } else {
+                opened = false;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), length);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const {
+        return opened;
+    }
+    const char* begin() const {
+        return data;
+    }
+    const char* end() const {
+        return data + length;
+    }
+
+private:
+    bool opened = false;
+    const char* data = nullptr;
+    size_t length = 0;
 };
 
-class NumberedTileHelper {
+// The puzzles of the input, each a run of one digit per tile in the compact format. Records of compact files are
+// left in their mapping, which the set keeps open, and only get decoded when they are solved. Puzzles in the grid
+// format are packed into one buffer the same way. A puzzle costs one small record beyond its tiles, with nothing
+// allocated for it alone.
+class PuzzleSet {
 public:
-    void addTile(int row, int col) {
-        if (puzzle[row][col] != 1) {
-            ++unassignedTiles;
-            puzzle[row][col] = 1;
+    size_t size() const {
+        return records.size();
+    }
+    int gridSize(size_t index) const {
+        return records[index].gridSize;
+    }
+    // decodes a puzzle into input, reusing its storage
+    void decode(size_t index, PuzzleInput& input) const {
+        const Record& record = records[index];
+        const char* tiles = (record.source == PACKED ? packed.data() : mappings[record.source]->begin()) +
+                            record.offset;
+        input.gridSize = record.gridSize;
+        input.values.resize(record.gridSize * record.gridSize);
+        for (size_t tile = 0; tile < input.values.size(); ++tile) {
+            input.values[tile] = tiles[tile] == '.' ? 0 : tiles[tile] - '0';
         }
     }
-    int getUnassignedTiles() {
-        return unassignedTiles;
+    // keeps a compact file mapped for as long as the set, returns the source to add its records with
+    uint32_t addMapping(std::unique_ptr<MappedFile> file) {
+        mappings.push_back(std::move(file));
+        return mappings.size() - 1;
+    }
+    // adds the record at tiles, which must lie in the mapping of source and hold valid tiles
+    void addMapped(uint32_t source, const char* tiles, int gridSize) {
+        records.push_back({size_t(tiles - mappings[source]->begin()), source, uint16_t(gridSize)});
+    }
+    // adds a puzzle read in the grid format
+    void addPacked(const PuzzleInput& input) {
+        records.push_back({packed.size(), PACKED, uint16_t(input.gridSize)});
+        for (uint8_t value : input.values) packed += char('0' + value);
     }
 
 private:
-    vector<vector<int>> puzzle = vector<vector<int>>(9, vector<int>(9, 0));
-    int unassignedTiles = 0;
+    static constexpr uint32_t PACKED = UINT32_MAX; // the source of packed puzzles
+
+    struct Record {
+        size_t offset = 0; // of the first tile in its source
+        uint32_t source = PACKED;
+        uint16_t gridSize = 0;
+    };
+    vector<std::unique_ptr<MappedFile>> mappings;
+    string packed;
+    vector<Record> records;
 };
 
-// checks if a pair of coords is in the 9x9 grid
-bool isInGrid(int row, int col);
+// One client of the server, stdin and stdout or a socket. Requests are numbered as they are read and finished in
+// any order by the workers, but the responses go out in request order. The connection writes them on a thread of
+// its own, so a client that is slow to read holds up only its own requests: once SERVER_WINDOW of them are in
+// flight, expect waits for the oldest to go out.
+class Connection {
+public:
+    Connection(int inputFd, int outputFd, bool ownsFds)
+        : inputFd(inputFd), outputFd(outputFd), ownsFds(ownsFds), writer(&Connection::writeResponses, this) {}
+    ~Connection() {
+        if (writer.joinable()) close();
+        if (!ownsFds) return;
+        ::close(inputFd);
+        if (outputFd != inputFd) ::close(outputFd);
+    }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    int input() const {
+        return inputFd;
+    }
+    // returns the number of a new request, whose response is owed before any later one
+    size_t expect() {
+        std::unique_lock<std::mutex> lock(mutex);
+        space.wait(lock, [&]() { return window.size() < SERVER_WINDOW; });
+        window.emplace_back();
+        return written + window.size() - 1;
+    }
+    // stores the response to a request for the writer
+    void finish(size_t request, string response) {
+        std::lock_guard<std::mutex> lock(mutex);
+        window[request - written] = {true, std::move(response)};
+        if (request == written) ready.notify_one();
+    }
+    // once the last request has been read, blocks until every response has been written
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reading = false;
+        }
+        ready.notify_one();
+        writer.join();
+    }
+
+private:
+    // writes out the responses that are next in line as they are finished, until the requests end
+    void writeResponses() {
+        bool broken = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [&]() { return window.empty() ? !reading : window.front().first; });
+            if (window.empty()) return;
+            string out;
+            for (; !window.empty() && window.front().first; ++written) {
+                out += window.front().second;
+                window.pop_front();
+            }
+            space.notify_one();
+            lock.unlock();
+            // once the client has gone away its remaining responses are dropped
+            for (size_t sent = 0; sent < out.size() && !broken;) {
+                ssize_t count = ::write(outputFd, out.data() + sent, out.size() - sent);
+                if (count < 0 && errno == EINTR) continue;
+                broken = count < 0;
+                sent += std::max<ssize_t>(count, 0);
+            }
+            lock.lock();
+        }
+    }
+
+    int inputFd;
+    int outputFd;
+    bool ownsFds;
+    std::mutex mutex;
+    std::condition_variable ready; // the next response is finished, or the requests have ended
+    std::condition_variable space; // the window has room for another request
+    std::deque<std::pair<bool, string>> window; // requests from number written on, and whether each is finished
+    size_t written = 0;
+    bool reading = true;
+    std::thread writer;
+};
+
+// The 8 symmetries of the square. Each maps rows, columns and boxes onto rows, columns and boxes and keeps the
+// neighbours of every tile its neighbours, so it maps a puzzle's solutions onto the solutions of its image. Bit 0
+// transposes, bit 1 flips the rows upside down and bit 2 flips the columns.
+constexpr int SYMMETRIES = 8;
+
+// returns where a tile ends up under a symmetry
+inline int transformTile(int tile, int gridSize, int symmetry) {
+    int row = tile / gridSize;
+    int col = tile % gridSize;
+    if (symmetry & 1) std::swap(row, col);
+    if (symmetry & 2) row = gridSize - 1 - row;
+    if (symmetry & 4) col = gridSize - 1 - col;
+    return row * gridSize + col;
+}
+
+// What the cache keeps for one canonical puzzle. The bombs are those of the canonical variant.
+struct CachedSolution {
+    int status = SOLVER_UNSOLVABLE;
+    int goalDepth = 0;
+    vector<uint8_t> bombs;
+};
+
+// Bounded map from canonical puzzle keys to their solutions that evicts the least recently used entry. Shared by
+// all the server's workers, so every call takes the lock.
+class SolutionCache {
+public:
+    explicit SolutionCache(size_t capacity) : capacity(capacity) {}
+
+    // copies the entry for key into solution and makes it the most recently used
+    bool find(const string& key, CachedSolution& solution) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(key);
+        if (found == index.end()) {
+            ++misses;
+            return false;
+        }
+        ++hits;
+        entries.splice(entries.begin(), entries, found->second);
+        solution = found->second->second;
+        return true;
+    }
+    void insert(const string& key, CachedSolution solution) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // another worker may have solved a variant of the same puzzle in the meantime
+        if (index.count(key)) return;
+        entries.emplace_front(key, std::move(solution));
+        index[key] = entries.begin();
+        if (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+    // hits, misses and entries held, as reported by the server
+    string counters() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::to_string(hits) + " " + std::to_string(misses) + " " + std::to_string(entries.size());
+    }
+
+private:
+    size_t capacity;
+    std::mutex mutex;
+    std::list<std::pair<string, CachedSolution>> entries; // most recently used first
+    std::unordered_map<string, std::list<std::pair<string, CachedSolution>>::iterator> index;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+#endif
+
+// Grid geometry. These are defined up front so the masks can be built at compile time.
+
+// checks if a pair of coords is in the grid
+template <typename G>
+constexpr bool isInGrid(int row, int col) {
+    return !(row < 0 || row >= G::GRID_SIZE || col < 0 || col >= G::GRID_SIZE);
+}
+
+// returns a box using coords, numbered the same way as getStartCoordsFromBox
+template <typename G>
+constexpr int getBoxFromCoords(int row, int col) {
+    return (row / G::BOX_SIZE) * G::BOX_SIZE + col / G::BOX_SIZE;
+}
+
+// returns a pair of coords to start from based on a box
+template <typename G>
+constexpr Pair getStartCoordsFromBox(int box) {
+    return {.row = (box / G::BOX_SIZE) * G::BOX_SIZE, .col = (box % G::BOX_SIZE) * G::BOX_SIZE};
+}
+
+// index of a row, column or box in the units arrays
+template <typename G>
+constexpr int rowUnit(int row) {
+    return row;
+}
+template <typename G>
+constexpr int colUnit(int col) {
+    return G::GRID_SIZE + col;
+}
+template <typename G>
+constexpr int boxUnit(int box) {
+    return 2 * G::GRID_SIZE + box;
+}
+
+// returns the bitboard with only the tile at (row, col) set
+template <typename G>
+constexpr typename G::Bits tileBit(int row, int col) {
+    return G::Bits::bit(row * G::GRID_SIZE + col);
+}
+
+// builds the unit and neighbour tables
+template <typename G>
+constexpr Masks<G> makeMasks() {
+    Masks<G> masks;
+    for (int row = 0; row < G::GRID_SIZE; ++row) {
+        for (int col = 0; col < G::GRID_SIZE; ++col) {
+            int tileUnits[3] = {rowUnit<G>(row), colUnit<G>(col), boxUnit<G>(getBoxFromCoords<G>(row, col))};
+            for (int i = 0; i < 3; ++i) {
+                masks.units[tileUnits[i]] |= tileBit<G>(row, col);
+                masks.tileUnits[row * G::GRID_SIZE + col][i] = tileUnits[i];
+            }
+        }
+    }
+    for (int row = 0; row < G::GRID_SIZE; ++row) {
+        for (int col = 0; col < G::GRID_SIZE; ++col) {
+            for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
+                for (int colOffset = -1; colOffset < 2; ++colOffset) {
+                    if (rowOffset == 0 && colOffset == 0) continue;
+                    if (!isInGrid<G>(row + rowOffset, col + colOffset)) continue;
+                    int tile = row * G::GRID_SIZE + col;
+                    masks.neighbours[tile] |= tileBit<G>(row + rowOffset, col + colOffset);
+                    masks.neighbourList[tile][masks.neighbourCount[tile]++] =
+                        (row + rowOffset) * G::GRID_SIZE + col + colOffset;
+                }
+            }
+        }
+    }
+    return masks;
+}
+
+template <typename G>
+constexpr Masks<G> MASKS = makeMasks<G>();
+
+// step of the splitmix64 generator, used to fill the Zobrist table at compile time
+constexpr uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// One random key per tile for each of BOMB and EMPTY
+template <typename G>
+struct ZobristTable {
+    ZobristKey keys[G::CELLS][2] = {};
+};
+
+template <typename G>
+constexpr ZobristTable<G> makeZobristTable() {
+    ZobristTable<G> table;
+    uint64_t state = 0x5eed;
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        for (int value = 0; value < 2; ++value) {
+            ZobristKey high = splitMix64(state);
+            table.keys[tile][value] = (high << 64) | splitMix64(state);
+        }
+    }
+    return table;
+}
+
+template <typename G>
+constexpr ZobristTable<G> ZOBRIST = makeZobristTable<G>();
+
+// number of set bits in a bitboard
+template <int Words>
+int popcount(const Bitboard<Words>& board);
+
+// index of the lowest set bit, the board must not be empty
+template <int Words>
+int lowestTile(const Bitboard<Words>& board);
+
+// returns the index of the lowest set bit and clears it, the board must not be empty
+template <int Words>
+int popLowestTile(Bitboard<Words>& board);
+
+// blank tiles that have not been given a value yet
+template <typename G>
+typename G::Bits unassignedTiles(const Puzzle<G>& puzzle);
+
+// returns the bitboard a trail entry refers to
+template <typename G>
+typename G::Bits& trailedField(Puzzle<G>& puzzle, TrailField field);
+
+// fills the unit and numbered tile counts of a freshly read puzzle
+template <typename G>
+void initConstraintCounts(Puzzle<G>& puzzle);
+
+// moves a tile into (delta = 1) or out of (delta = -1) an assignment in every constraint it belongs to
+template <typename G>
+void updateConstraintCounts(int tile, TrailField assignment, int delta, Puzzle<G>& puzzle);
+
+// does the same for a single constraint made of the given tiles. When that leaves exactly one other tile
+// unassigned, that tile loses (or regains) the constraint from its degree.
+template <typename G>
+void updateConstraint(const typename G::Bits& members, ConstraintCounts& counts, int tile, TrailField assignment,
+                      int delta, Puzzle<G>& puzzle);
+
+// moves a tile to another degree bucket
+template <typename G>
+void setDegree(int tile, int degree, Puzzle<G>& puzzle);
+
+// assigns an unassigned tile and records it on the trail
+template <typename G>
+void assignTile(int row, int col, Assignment assignment, Puzzle<G>& puzzle, Trail<G>& trail);
+
+// removes a value (CAN_BE_BOMB or CAN_BE_EMPTY) from the domains of the given tiles and records it on the trail
+template <typename G>
+void removeFromDomain(const typename G::Bits& tiles, TrailField domain, Puzzle<G>& puzzle, Trail<G>& trail);
+
+// pops the trail back to a saved size, reverting every change made since
+template <typename G>
+void undoTo(int mark, Puzzle<G>& puzzle, Trail<G>& trail);
+
+// takes a pair of coordinates and returns how many constraints (its row, column and box, and the numbered
+// tiles next to it) still involve another unassigned tile
+template <typename G>
+int degreeHeuristic(int row, int col, const Puzzle<G>& puzzle);
+
+#ifndef SOLVER_LIBRARY
+// Reads every puzzle in a file, in order. Puzzles are separated by blank lines and the grid size of each is the
+// number of values on its first row, written with or without spaces between them. A file in the compact format is
+// read by readCompactPuzzles instead. A directory is read file by file in name order.
+bool readPuzzles(const string& filePath, PuzzleSet& puzzles);
+bool readPuzzleFile(const string& filePath, PuzzleSet& puzzles);
+
+// Compact format: one puzzle per line, one digit per tile in row-major order with 0 or . for a blank tile, so a
+// 9x9 puzzle is a line of 81 characters. Lines starting with # and blank lines are skipped. The first malformed
+// record is reported with its line number. The records are added as they lie in the mapping of source.
+bool readCompactPuzzles(const char* begin, const char* end, const string& filePath, uint32_t source,
+                        PuzzleSet& puzzles);
+
+// Checks one compact record, without its line break, and sets gridSize from its length. Returns what is wrong with
+// it, or an empty string.
+string checkCompactRecord(const char* line, size_t tiles, int& gridSize);
+// Checks one compact record the same way and parses it into puzzle
+string parseCompactRecord(const char* line, size_t tiles, PuzzleInput& puzzle);
+
+// true if the first line holding a puzzle is a whole 9x9, 16x16 or 25x25 puzzle with no spaces in it. A grid row
+// may have no spaces either, but it is only as long as the grid is wide.
+bool isCompactFormat(const char* begin, const char* end);
+
+// returns the path itself, or every regular file of a directory in name order
+vector<string> listPuzzleFiles(const string& filePath);
+
+// Checks that a puzzle has a supported board size for the options given
+bool isSolvable(int gridSize, const Options& options);
+#endif
+
+// Creates the bitboards representing the puzzle from the values read
+template <typename G>
+Puzzle<G> makePuzzle(const uint8_t* values, int bombsPerUnit);
+
+#ifndef SOLVER_LIBRARY
+// Picks the kernels built for the board size of a puzzle and returns its answer
+SolveResult solve(const PuzzleInput& input, const Options& options);
+
+// Solves a puzzle of one board size and returns its answer
+template <typename G>
+SolveResult solvePuzzle(const vector<uint8_t>& values, const Options& options);
+
+// the node budget, deadline and inference of the options for a solve starting now
+SearchControl searchLimits(const Options& options);
+#endif
+
+// the node budget and deadline of the config for a library solve starting now
+SearchControl searchLimits(const SolverConfig& config);
+
+// the checks of reading and isSolvable, without the messages, for a puzzle given to the library
+bool isValidPuzzle(const uint8_t* values, int gridSize, int bombsPerUnit);
+
+// The node count of a solve: the nodes in the table plus otherNodes, those counted outside it by the engines that
+// keep their own count, which are CDCL, the workers of a parallel search and the winner of a portfolio
+size_t totalNodes(const NodeTable& nodes, size_t otherNodes);
+
+#ifndef SOLVER_LIBRARY
+// Counts the solutions of a puzzle after its initial inference, up to the cap in the options. Returns the answer
+// for the first solution followed by the number of solutions, which is a lower bound when it equals the cap or
+// the control gives up. An inconsistent puzzle has no solutions.
+template <typename G>
+SolveResult countSolutions(Puzzle<G>& puzzle, Trail<G>& trail, NodeTable& nodes, const Options& options,
+                           bool consistent, SearchControl& control);
+
+// Counts the solutions of a puzzle read from values, up to cap. The nodes generated are counted in nodes. A search
+// that runs past the node budget counts as having found cap solutions.
+template <typename G>
+size_t solutionCount(const vector<uint8_t>& values, int bombsPerUnit, size_t cap, NodeTable& nodes,
+                     size_t nodeBudget = SIZE_MAX);
+
+// Generates puzzles on all the threads and streams them to stdout as they are made, each preceded by a comment
+// with the number of nodes the solver takes on it. Returns false once GENERATOR_ATTEMPTS layouts in a row gave no
+// puzzle in the difficulty range.
+bool generatePuzzles(const Options& options);
+template <typename G>
+bool generatePuzzlesOfSize(const Options& options);
+
+// Samples a layout with bombsPerUnit bombs in every unit from a shuffled sudoku pattern. 1 marks a bomb.
+template <typename G>
+vector<uint8_t> sampleLayout(int bombsPerUnit, std::mt19937_64& random);
+
+// Puts a clue on every empty tile next to a bomb, then takes clues away in random order as long as the puzzle
+// keeps exactly one solution. Returns false when the layout has no unique puzzle to start from.
+template <typename G>
+bool makeUniquePuzzle(const vector<uint8_t>& layout, int bombsPerUnit, std::mt19937_64& random,
+                      vector<uint8_t>& values);
+
+// Runs every corpus, a puzzle file or each file of a directory, through the solver one puzzle at a time with
+// warmup and repeated trials. Prints a summary line per corpus and writes the results as JSON.
+int runBenchmark(const Options& options);
+
+// Stays resident and answers puzzles in the compact format, one per line, on stdin or on every connection to the
+// socket in the options. Requests are solved on a pool of workers that each keep a warm Solver, so a client can
+// have up to SERVER_WINDOW in flight. Each gets one line back, in request order:
+//   solved <goal depth> <nodes> <one digit per tile, 1 for a bomb>
+//   unsolvable <goal depth> <nodes>
+//   gaveup <goal depth> <nodes>, when the node budget or the deadline of a solve runs out
+//   error <what is wrong with the request>
+// With a cache, a puzzle that is a repeat or a rotation, reflection or transposition of one already answered is
+// answered from the cache with 0 nodes, and the request line "cache" gets "cache <hits> <misses> <entries>".
+// Serving stdin ends at end of input, serving a socket runs until the process is stopped.
+int runServer(const Options& options);
+
+// Returns the smallest of the 8 symmetric variants of a puzzle in row-major order, packed two tiles to a byte, and
+// sets symmetry to the one that maps the puzzle onto it. Every variant of a puzzle gets the same key.
+string canonicalKey(const vector<uint8_t>& values, int gridSize, int& symmetry);
+
+// Binds and listens on a Unix socket, returns the listening socket or -1 with errno set
+int listenOn(const string& socketPath);
+
+// Reads requests from a connection until its input ends and queues them for the workers, then waits for the last
+// response to be written
+struct ServerJob {
+    std::shared_ptr<Connection> connection;
+    size_t request = 0;
+    string line;
+};
+void readRequests(std::shared_ptr<Connection> connection, BlockingQueue<ServerJob>& jobs);
+
+// Solves one request with the worker's own solver, or looks it up in the cache if there is one, and returns its
+// response line
+string answerRequest(const string& line, Solver& solver, SolutionCache* cache, PuzzleInput& puzzle,
+                     vector<uint8_t>& bombs);
+
+// Solves all the puzzles on a fixed pool of threads and streams their answers to the writer in input order, as
+// soon as every puzzle before them is done too. Text answers are separated by blank lines.
+void solveBatch(const PuzzleSet& puzzles, const Options& options, ResultWriter& writer);
+
+// number of threads to run for the given amount of independent work
+size_t workerCount(const Options& options, size_t work);
+
+// Solves the puzzles claimed through next LANES at a time, with their propagation and variable selection run as
+// vector operations over all the lanes. Every lane searches its own puzzle with the same choices and node count
+// as backtrackingSearch, and takes the next puzzle as soon as it is done. Puzzles of another size, and those that
+// fail their initial inference, are solved one at a time instead. deliver(index, answer) gets every answer.
+template <typename G, typename Deliver>
+void lockstepBatch(const PuzzleSet& puzzles, const Options& options, std::atomic<size_t>& next,
+                   Deliver deliver);
+
+// Puts a puzzle in a lane of the board. Returns false for a puzzle with more bombs around a number than it has
+// blank neighbours, which only the scalar search reports the way it should.
+template <typename G>
+bool loadLane(const Puzzle<G>& puzzle, int lane, LaneBoard<G>& board);
+
+// Runs the unit and numbered-tile rules of forward checking on every lane until nothing more is forced, reaching
+// the same state as propagate. Sets failed to the lanes that hit a contradiction.
+template <typename G>
+void propagateLanes(LaneBoard<G>& board, int bombsPerUnit, LaneWord& failed);
+
+// Picks the tile every lane branches on next the way selectUnassignedVariable does, -1 for a complete lane. Only
+// meaningful after a propagation without contradiction, which leaves both values to every unassigned tile.
+template <typename G>
+void selectLaneTiles(const LaneBoard<G>& board, int tiles[LANES]);
+
+// Backs a failed lane up to its deepest decision with BOMB still untried and assigns BOMB, like the second pass of
+// backtrackingSearch. Returns false once every decision has been tried.
+template <typename G>
+bool backtrackLane(LaneBoard<G>& board, int lane, LaneSearch<G>& search);
+
+// the bitboard of one lane
+template <typename G>
+typename G::Bits laneBits(const LaneWord* words, int lane);
+
+template <typename G>
+void setLaneBits(LaneWord* words, int lane, const typename G::Bits& bits);
+
+// Sets count to the number of bits of each lane in bits & mask, up to 255. Lane words go out through references
+// rather than return values, since GCC warns that their ABI differs between builds with and without AVX-512.
+template <typename G>
+void lanePopcount(const LaneWord* bits, const typename G::Bits& mask, LaneWord& count);
+
+// sets any to -1 in the lanes with any bit set, leaving the others as they are
+template <typename G>
+void laneAny(const LaneWord* bits, LaneWord& any);
+
+// Adds one to the bit-sliced counts of every tile in bits, for counts of up to Slices bits
+template <typename G, int Slices>
+void addToCounts(LaneWord counts[][G::Bits::WORDS], const LaneWord* bits);
+
+// Calls visit with bits moved onto the tiles next to them, once for each of the 8 directions
+template <typename G, typename Visit>
+void forEachNeighbourShift(const LaneWord* bits, Visit visit);
+
+// the number of tiles of bits next to every tile, bit sliced
+template <typename G>
+void neighbourCounts(const LaneWord* bits, LaneWord counts[4][G::Bits::WORDS]);
+
+// Searches a puzzle on all the threads. On success the puzzle holds the first solution found. Nodes generated
+// while splitting go in splitNodes and the number generated by the workers is added to workerNodes. Every worker
+// gets the limits of the control, which gives up if a worker does before anything is found.
+template <typename G>
+bool parallelSearch(Puzzle<G>& puzzle, const Options& options, NodeTable& splitNodes, size_t& workerNodes,
+                    SearchControl& control);
+
+// Expands the top decision levels of the search breadth first until there are at least target subproblems, in the
+// order the sequential search would visit them. Returns true with the puzzle solved if a solution turns up first.
+template <typename G>
+bool splitSearch(Puzzle<G>& puzzle, size_t target, vector<Puzzle<G>>& tasks, NodeTable& nodes);
+#endif
+
+// Solves a puzzle for the Solver library with its scratch state in the arena. The solution goes to bombs, one
+// byte per tile.
+template <typename G>
+bool solveInArena(const uint8_t* values, const SolverConfig& config, Arena& arena, NodeTable& nodes, uint8_t* bombs,
+                  SolverResult& result);
+
+// Searches on from the state after the initial inference of a library solve, consistent or not, with the engine of
+// the config and fills in the result and bombs. A search that gives up leaves the bombs inference found.
+template <typename G>
+bool finishSolve(Puzzle<G>& puzzle, Trail<G>& trail, bool consistent, const SolverConfig& config, NodeTable& nodes,
+                 SearchControl& control, uint8_t* bombs, SolverResult& result);
+
+// Starts an edit session of a puzzle in the arena and answers it, the same way as solveInArena
+template <typename G>
+EditSession<G>* loadSession(const uint8_t* values, const SolverConfig& config, Arena& arena, NodeTable& nodes,
+                            uint8_t* bombs, SolverResult& result);
+
+// Applies one edit of Solver::edit to a session. The last answer stands if the new constraint on the tile keeps it,
+// otherwise resolveSession answers again. Returns false, with the session unchanged, for a bad edit.
+template <typename G>
+bool editSession(EditSession<G>& session, int tile, int edit, int number, const SolverConfig& config,
+                 NodeTable& nodes, uint8_t* bombs, SolverResult& result);
+
+// true if the last solution of a session keeps the pin or number on a tile
+template <typename G>
+bool solutionKeepsTile(const EditSession<G>& session, int tile);
+// true if it keeps every tile and the bombs of every unit
+template <typename G>
+bool solutionKeepsAll(const EditSession<G>& session, int bombsPerUnit);
+
+// Answers the tiles of a session from scratch, except that the domains start out as narrow as the root's while it is
+// valid and the search tries the values of the last solution first. The root becomes the state after inference.
+template <typename G>
+bool resolveSession(EditSession<G>& session, const SolverConfig& config, NodeTable& nodes, uint8_t* bombs,
+                    SolverResult& result);
+
+// Solves a puzzle with the CDCL engine, one variable per unassigned blank tile. On success the puzzle holds the
+// solution. The decisions made are added to nodes and count against the node limit of the control.
+template <typename G>
+bool cdclSearch(Puzzle<G>& puzzle, size_t& nodes, SearchControl* control = nullptr);
+
+#ifndef SOLVER_LIBRARY
+// Formats the goal depth, node count and solution grid of an answer. An answer without a solution ends in a line
+// that says why, unsolvable or gaveup as the server puts it, so that a search that ran out of budget can be told
+// from one that proved there is no solution. Its grid only holds the bombs inference proved.
+template <typename G>
+string formatAnswer(const Puzzle<G>& puzzle, size_t nodes, int status);
+
+// Packs an answer into a binary record, little endian: a status byte (a SolverStatus), the grid size
+// byte, the goal depth as 2 bytes, the node count as 8 bytes, then the bomb mask with one bit per tile in row-major
+// order, the first tile in the lowest bit of the first byte. A 9x9 record is 23 bytes.
+template <typename G>
+string packAnswer(const Puzzle<G>& puzzle, size_t nodes, int status);
+#endif
+
+// Searches depth first from the current state, as the control directs. A search that expires leaves its
+// assignments on the trail for the caller to undo. When solutions is given, every solution is counted and the
+// search only stops once the cap is reached or it expires.
+template <typename G>
+bool backtrackingSearch(Puzzle<G>& puzzle, Trail<G>& trail, NodeTable& nodes, SearchControl* control = nullptr,
+                        SolutionCount<G>* solutions = nullptr);
+
+#ifndef SOLVER_LIBRARY
+// Runs backtrackingSearch from the current state with Luby restarts: run i may make luby(i) * unit decisions
+// before the search starts over from the same state, breaking ties with the generator where it left off
+template <typename G>
+bool restartingSearch(Puzzle<G>& puzzle, Trail<G>& trail, NodeTable& nodes, SearchControl& control, size_t unit);
+
+// Races differently configured searches of a puzzle on all the threads and keeps the first to finish, with a
+// solution or with the proof that there is none. Member 0 is the plain search, member 1 tries bombs first and the
+// rest break ties at random and restart on the Luby sequence. Each member gets the limits of the control and the
+// nodes of the winner are added to nodes. If every member gives up, so does the control.
+template <typename G>
+bool portfolioSearch(Puzzle<G>& puzzle, const Options& options, SearchControl& control, size_t& nodes);
+#endif
+
+// Inference functions. Every domain change is recorded on the trail; on failure the caller pops the trail
+// back to the mark it took before assigning.
+
+// Propagates the assignment of (row, col) until no more tiles are forced
+template <typename G>
+bool forwardChecking(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail);
+
+// Checks every unit and numbered tile of a freshly read puzzle and propagates what they force
+template <typename G>
+bool initialInference(Puzzle<G>& puzzle, Trail<G>& trail);
+
+// Assigns every unassigned tile whose domain is down to one value and queues it. Fails if a domain is empty.
+template <typename G>
+bool assignForcedTiles(Puzzle<G>& puzzle, Trail<G>& trail, PropagationQueue<G>& queue);
+
+// Forward checks queued tiles, assigning forced tiles as they appear, until the queue runs dry
+template <typename G>
+bool propagate(Puzzle<G>& puzzle, Trail<G>& trail, PropagationQueue<G>& queue);
+
+// Forward checks all the tiles in the row, column, and box. If forward check succeeds, tile domains get updated
+template <typename G>
+bool forwardCheckUnit(int unit, Puzzle<G>& puzzle, Trail<G>& trail);
+template <typename G>
+bool forwardCheckRow(int row, Puzzle<G>& puzzle, Trail<G>& trail);
+template <typename G>
+bool forwardCheckCol(int col, Puzzle<G>& puzzle, Trail<G>& trail);
+template <typename G>
+bool forwardCheckBox(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail);
+
+// Checks if a specific numbered tile needs to update domains of the tiles around it
+template <typename G>
+bool forwardCheckNumberedTile(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail);
+// Checks all numbered tiles around a newly assigned tile and forward checks each individual tile with function
+// above.
+template <typename G>
+bool forwardCheckNumberedTiles(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail);
+
+// Subset and overlap rules between a numbered tile and each unit or other numbered tile whose open tiles overlap its
+// own. The bombs either constraint still needs bound the bombs in the shared tiles, which can settle the tiles only
+// one of them has, as when one clue's open tiles are a subset of another's. Runs until neither these rules nor the
+// forward checking they set off find anything more, returns false on a contradiction.
+template <typename G>
+bool subsetInference(Puzzle<G>& puzzle, Trail<G>& trail);
+
+// The key of a state in the refutation table: the hash of the assignments mixed with the domains of the unassigned
+// tiles, which differ between states that ruled out different values on the way
+template <typename G>
+ZobristKey stateKey(const Puzzle<G>& puzzle);
+
+// chooses the next best tile by mrv and then degree from the degree buckets, returns false if there is none. Ties
+// go to the first tile, or to a random one when given a nonzero generator state.
+template <typename G>
+bool selectUnassignedVariable(const Puzzle<G>& puzzle, Pair& chosenTile, uint64_t* random = nullptr);
+
+// sees if there are any unassigned tiles in the puzzle
+template <typename G>
+bool isPuzzleComplete(const Puzzle<G>& puzzle);
+
+#ifndef SOLVER_LIBRARY
+// Testing function that prints out the layout of the puzzle
+template <typename G>
+string puzzleStatus(const Puzzle<G>& puzzle);
+#endif
+
+// Gets the goal depth of the puzzle by counting how many 0s
+template <typename G>
+int getGoalDepth(const Puzzle<G>& puzzle);
+
+} // namespace
+
+// left out of the library build, which is the same file compiled with -DSOLVER_LIBRARY
+#ifndef SOLVER_LIBRARY
+int main(int argc, char* argv[]) {
+    Options options;
+    bool validArgs = true;
+    for (int arg = 1; arg < argc; ++arg) {
+        string option = argv[arg];
+        if (option == "--nodes=all") {
+            options.counting = ALL_NODES;
+        } else if (option == "--nodes=distinct") {
+            options.counting = DISTINCT_NODES;
+        } else if (option.rfind("--bombs=", 0) == 0) {
+            options.bombsPerUnit = std::atoi(option.c_str() + 8);
+            validArgs = validArgs && options.bombsPerUnit > 0;
+        } else if (option == "--batch") {
+            options.batch = true;
+        } else if (option == "--parallel") {
+            options.parallel = true;
+        } else if (option == "--count") {
+            options.solutionCap = SIZE_MAX;
+        } else if (option.rfind("--count=", 0) == 0) {
+            options.solutionCap = std::strtoull(option.c_str() + 8, nullptr, 10);
+            validArgs = validArgs && options.solutionCap > 0;
+        } else if (option == "--engine=cdcl") {
+            options.engine = CDCL;
+        } else if (option == "--engine=backtracking") {
+            options.engine = BACKTRACKING;
+        } else if (option == "--generate") {
+            options.generate = true;
+        } else if (option.rfind("--generate=", 0) == 0) {
+            options.generate = true;
+            options.puzzleCount = std::strtoull(option.c_str() + 11, nullptr, 10);
+            validArgs = validArgs && options.puzzleCount > 0;
+        } else if (option.rfind("--size=", 0) == 0) {
+            options.gridSize = std::atoi(option.c_str() + 7);
+        } else if (option.rfind("--difficulty=", 0) == 0) {
+            char* end = nullptr;
+            options.minDifficulty = std::strtoull(option.c_str() + 13, &end, 10);
+            if (*end == '-') options.maxDifficulty = std::strtoull(end + 1, nullptr, 10);
+            validArgs = validArgs && options.minDifficulty <= options.maxDifficulty;
+        } else if (option.rfind("--seed=", 0) == 0) {
+            options.seed = std::strtoull(option.c_str() + 7, nullptr, 10);
+        } else if (option == "--bench") {
+            options.bench = true;
+        } else if (option.rfind("--warmup=", 0) == 0) {
+            options.warmup = std::atoi(option.c_str() + 9);
+            validArgs = validArgs && options.warmup >= 0;
+        } else if (option.rfind("--trials=", 0) == 0) {
+            options.trials = std::atoi(option.c_str() + 9);
+            validArgs = validArgs && options.trials > 0;
+        } else if (option.rfind("--results=", 0) == 0) {
+            options.resultsPath = option.substr(10);
+        } else if (option == "--stats") {
+            options.stats = true;
+        } else if (option.rfind("--stats=", 0) == 0) {
+            options.stats = true;
+            options.statsPath = option.substr(8);
+            validArgs = validArgs && !options.statsPath.empty();
+        } else if (option == "--serve") {
+            options.serve = true;
+        } else if (option.rfind("--serve=", 0) == 0) {
+            options.serve = true;
+            options.socketPath = option.substr(8);
+            validArgs = validArgs && !options.socketPath.empty();
+        } else if (option.rfind("--cache=", 0) == 0) {
+            options.cacheEntries = std::strtoull(option.c_str() + 8, nullptr, 10);
+        } else if (option.rfind("--budget=", 0) == 0) {
+            options.nodeBudget = std::strtoull(option.c_str() + 9, nullptr, 10);
+            validArgs = validArgs && options.nodeBudget > 0;
+        } else if (option.rfind("--deadline=", 0) == 0) {
+            options.deadlineMs = std::atoi(option.c_str() + 11);
+            validArgs = validArgs && options.deadlineMs > 0;
+        } else if (option == "--portfolio") {
+            options.portfolio = true;
+        } else if (option == "--lockstep") {
+            options.lockstep = true;
+        } else if (option == "--refutations") {
+            options.refutationBytes = size_t(4) << 20;
+        } else if (option.rfind("--refutations=", 0) == 0) {
+            options.refutationBytes = std::strtoull(option.c_str() + 14, nullptr, 10) << 20;
+            validArgs = validArgs && options.refutationBytes > 0;
+        } else if (option == "--subsets") {
+            options.subsetDepth = INT_MAX;
+        } else if (option.rfind("--subsets=", 0) == 0) {
+            options.subsetDepth = std::atoi(option.c_str() + 10);
+            validArgs = validArgs && options.subsetDepth > 0;
+        } else if (option.rfind("--output=", 0) == 0) {
+            options.outputPath = option.substr(9);
+            validArgs = validArgs && !options.outputPath.empty();
+        } else if (option == "--format=text") {
+            options.format = TEXT_OUTPUT;
+        } else if (option == "--format=binary") {
+            options.format = BINARY_OUTPUT;
+        } else if (option.rfind("--threads=", 0) == 0) {
+            options.threads = std::atoi(option.c_str() + 10);
+            validArgs = validArgs && options.threads > 0;
+        } else if (options.filePath.empty()) {
+            options.filePath = option;
+        } else {
+            validArgs = false;
+        }
+    }
+    // parallel search and the CDCL engine stop at the first solution, and binary records have no room for a count.
+    // The server answers in lines of text with what a Solver can be configured with, and neither it nor the
+    // generator reads a puzzle file.
+    validArgs = validArgs && !(options.parallel && (options.batch || options.engine == CDCL)) &&
+                !(options.solutionCap > 0 &&
+                  (options.parallel || options.engine == CDCL || options.format == BINARY_OUTPUT)) &&
+                !(options.serve && (options.parallel || options.solutionCap > 0 || options.subsetDepth > 0 ||
+                                    options.format == BINARY_OUTPUT || options.batch || options.bench ||
+                                    options.generate)) &&
+                !((options.serve || options.generate) && !options.filePath.empty()) &&
+                !(options.cacheEntries > 0 && !options.serve) &&
+                !(options.portfolio && (options.batch || options.parallel || options.engine == CDCL ||
+                                        options.solutionCap > 0 || options.serve)) &&
+                !(options.lockstep && (!options.batch || options.bench || options.engine == CDCL ||
+                                       options.solutionCap > 0 || options.nodeBudget > 0 || options.deadlineMs > 0 ||
+                                       options.subsetDepth > 0)) &&
+                !(options.refutationBytes > 0 && !options.portfolio);
+    if (validArgs && options.serve) return runServer(options);
+    if (validArgs && options.generate) {
+        if (!isSolvable(options.gridSize, options)) return 1;
+        if (!generatePuzzles(options)) {
+            cout << "Gave up after " << GENERATOR_ATTEMPTS << " layouts in a row without a puzzle in the difficulty "
+                 << "range" << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (!validArgs || options.filePath.empty()) {
+        cout << "Run ./solve.o [--engine=backtracking|cdcl] [--nodes=distinct|all] [--bombs=perUnit] fileName "
+                "(e.g. ./solve.o input.txt)"
+             << endl;
+        cout << "or  ./solve.o --batch [--lockstep]|--parallel [--threads=count] [options] fileOrDirectory" << endl;
+        cout << "or  ./solve.o --count[=cap] [options] fileName to count solutions, --count=2 checks uniqueness"
+             << endl;
+        cout << "or  ./solve.o --bench [--warmup=passes] [--trials=passes] [--results=file.json] [options] "
+                "corpusFileOrDirectory"
+             << endl;
+        cout << "or  add --budget=nodes and --deadline=ms to give up on a solve, "
+             << "--portfolio races searches of one puzzle" << endl;
+        cout << "or  add --subsets[=levels] for subset and overlap inference at every search level or the first ones"
+             << endl;
+        cout << "or  add --refutations[=MiB] to --portfolio so that restarts skip refuted states, 4 MiB per member "
+                "by default"
+             << endl;
+        cout << "or  ./solve.o --serve[=socketPath] [--threads=count] [--cache=entries] [options] to answer one-line "
+                "puzzles on stdin or a Unix socket"
+             << endl;
+        cout << "or  add --output=file|- (- is stdout) and --format=text|binary to choose where and how answers go"
+             << endl;
+        cout << "or  add --stats[=file.json] to any of the above to write where the time goes, after a make stats build"
+             << endl;
+        cout << "or  ./solve.o --generate[=count] [--size=9|16|25] [--bombs=perUnit] [--difficulty=minNodes[-maxNodes]] "
+                "[--seed=seed] [--threads=count] > puzzles.txt"
+             << endl;
+        return 1;
+    }
+#ifndef SOLVER_STATS
+    if (options.stats) {
+        cout << "--stats needs a build with -DSOLVER_STATS, run make stats" << endl;
+        return 1;
+    }
+#endif
+    if (options.bench) {
+        int status = runBenchmark(options);
+#ifdef SOLVER_STATS
+        if (status == 0 && options.stats) writeStats(options.statsPath);
+#endif
+        return status;
+    }
+    PuzzleSet puzzles;
+    if (!readPuzzles(options.filePath, puzzles)) return 1;
+    if (!options.batch && puzzles.size() != 1) {
+        cout << options.filePath << " holds " << puzzles.size() << " puzzles, solve it with --batch" << endl;
+        return 1;
+    }
+    for (size_t index = 0; index < puzzles.size(); ++index) {
+        if (!isSolvable(puzzles.gridSize(index), options)) return 1;
+    }
+    ResultWriter writer(options.outputPath);
+    if (!writer.isOpen()) {
+        cout << "Cannot write to " << options.outputPath << endl;
+        return 1;
+    }
+    solveBatch(puzzles, options, writer);
+    writer.flush();
+    if (writer.failed()) {
+        cout << "Writing to " << options.outputPath << " failed" << endl;
+        return 1;
+    }
+#ifdef SOLVER_STATS
+    if (options.stats) writeStats(options.statsPath);
+#endif
+}
+#endif
+
+namespace {
+
+#ifndef SOLVER_LIBRARY
+bool readPuzzles(const string& filePath, PuzzleSet& puzzles) {
+    STATS_TIME(io);
+    for (const string& path : listPuzzleFiles(filePath)) {
+        if (!readPuzzleFile(path, puzzles)) return false;
+    }
+    return true;
+}
+
+vector<string> listPuzzleFiles(const string& filePath) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(filePath, error)) return {filePath};
+    vector<string> filePaths;
+    for (const auto& entry : std::filesystem::directory_iterator(filePath, error)) {
+        if (entry.is_regular_file()) filePaths.push_back(entry.path().string());
+    }
+    std::sort(filePaths.begin(), filePaths.end());
+    return filePaths;
+}
+
+bool readPuzzleFile(const string& filePath, PuzzleSet& puzzles) {
+    std::unique_ptr<MappedFile> file(new MappedFile(filePath));
+    if (!file->isOpen()) {
+        cout << "Invalid file " << filePath << endl;
+        return false;
+    }
+    if (isCompactFormat(file->begin(), file->end())) {
+        const char* begin = file->begin();
+        const char* end = file->end();
+        return readCompactPuzzles(begin, end, filePath, puzzles.addMapping(std::move(file)), puzzles);
+    }
+    fstream fd(filePath);
+    size_t first = puzzles.size();
+    PuzzleInput current;
+    string line;
+    size_t lineNumber = 0;
+    bool more = true;
+    while (more) {
+        more = bool(std::getline(fd, line));
+        lineNumber += more;
+        // comment lines, such as the ones the generator writes, are skipped without closing the puzzle
+        if (more && line.rfind("#", 0) == 0) continue;
+        istringstream numbers(line);
+        string token;
+        int rowLength = 0;
+        while (more && numbers >> token) {
+            // a row may also run its values together, one digit per tile
+            for (char value : token) {
+                if (value < '0' || value > '8') {
+                    cout << "Invalid tile value '" << token << "' on line " << lineNumber << " of " << filePath
+                         << endl;
+                    return false;
+                }
+                current.values.push_back(value - '0');
+                ++rowLength;
+            }
+        }
+        if (current.gridSize == 0) current.gridSize = rowLength;
+        if (rowLength > 0 && rowLength != current.gridSize) {
+            cout << "Invalid row on line " << lineNumber << " of " << filePath << ", expected " << current.gridSize
+                 << " values like the first row of its puzzle but found " << rowLength << endl;
+            return false;
+        }
+        // a blank line or the end of the file closes the current puzzle
+        if (rowLength > 0 || current.values.empty()) continue;
+        if (current.values.size() != size_t(current.gridSize) * current.gridSize) {
+            cout << "Invalid puzzle " << puzzles.size() - first + 1 << " ending on line " << lineNumber << " of "
+                 << filePath << ", expected a square grid of numbers" << endl;
+            return false;
+        }
+        puzzles.addPacked(current);
+        current.values.clear();
+        current.gridSize = 0;
+    }
+    if (puzzles.size() == first) {
+        cout << "Invalid file " << filePath << ", expected a square grid of numbers" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool isCompactFormat(const char* begin, const char* end) {
+    for (const char* line = begin; line < end;) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (!lineEnd) lineEnd = end;
+        const char* first = line;
+        while (first < lineEnd && std::isspace(static_cast<unsigned char>(*first))) ++first;
+        if (first < lineEnd && *first != '#') {
+            const char* last = lineEnd;
+            while (std::isspace(static_cast<unsigned char>(last[-1]))) --last;
+            size_t tiles = last - first;
+            if (tiles != 81 && tiles != 256 && tiles != 625) return false;
+            return std::find_if(first, last, [](char c) { return std::isspace(static_cast<unsigned char>(c)); }) ==
+                   last;
+        }
+        line = lineEnd + 1;
+    }
+    return false;
+}
+
+bool readCompactPuzzles(const char* begin, const char* end, const string& filePath, uint32_t source,
+                        PuzzleSet& puzzles) {
+    size_t first = puzzles.size();
+    size_t lineNumber = 0;
+    for (const char* line = begin; line < end;) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (!lineEnd) lineEnd = end;
+        const char* next = lineEnd + 1;
+        ++lineNumber;
+        if (lineEnd > line && lineEnd[-1] == '\r') --lineEnd;
+        size_t tiles = lineEnd - line;
+        if (tiles == 0 || *line == '#') {
+            line = next;
+            continue;
+        }
+        int gridSize = 0;
+        string error = checkCompactRecord(line, tiles, gridSize);
+        if (!error.empty()) {
+            cout << "Invalid record on line " << lineNumber << " of " << filePath << ", " << error << endl;
+            return false;
+        }
+        puzzles.addMapped(source, line, gridSize);
+        line = next;
+    }
+    if (puzzles.size() == first) {
+        cout << "Invalid file " << filePath << ", expected one puzzle per line" << endl;
+        return false;
+    }
+    return true;
+}
+
+string checkCompactRecord(const char* line, size_t tiles, int& gridSize) {
+    gridSize = tiles == 81 ? 9 : tiles == 256 ? 16 : tiles == 625 ? 25 : 0;
+    if (gridSize == 0) return "expected 81, 256 or 625 tiles but found " + std::to_string(tiles);
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        if (line[tile] != '.' && (line[tile] < '0' || line[tile] > '8')) {
+            return "invalid tile '" + string(1, line[tile]) + "' in column " + std::to_string(tile + 1);
+        }
+    }
+    return "";
+}
+
+string parseCompactRecord(const char* line, size_t tiles, PuzzleInput& puzzle) {
+    string error = checkCompactRecord(line, tiles, puzzle.gridSize);
+    if (!error.empty()) return error;
+    puzzle.values.resize(tiles);
+    for (size_t tile = 0; tile < tiles; ++tile) puzzle.values[tile] = line[tile] == '.' ? 0 : line[tile] - '0';
+    return "";
+}
+
+bool isSolvable(int gridSize, const Options& options) {
+    if (gridSize != 9 && gridSize != 16 && gridSize != 25) {
+        cout << "Unsupported grid size " << gridSize << ", expected 9, 16 or 25 columns" << endl;
+        return false;
+    }
+    if (options.bombsPerUnit >= gridSize) {
+        cout << "A " << gridSize << "x" << gridSize << " grid needs fewer than " << gridSize
+             << " bombs per unit" << endl;
+        return false;
+    }
+    return true;
+}
+#endif
+
+template <typename G>
+Puzzle<G> makePuzzle(const uint8_t* values, int bombsPerUnit) {
+    Puzzle<G> result;
+    if (bombsPerUnit > 0) {
+        result.bombsPerUnit = bombsPerUnit;
+        result.emptysPerUnit = G::GRID_SIZE - bombsPerUnit;
+    }
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        auto bit = G::Bits::bit(tile);
+        result.nums[tile] = values[tile];
+        if (values[tile] == 0) {
+            result.canBeBomb |= bit;
+            result.canBeEmpty |= bit;
+        } else {
+            result.numbered |= bit;
+            result.empties |= bit;
+        }
+    }
+    initConstraintCounts(result);
+    return result;
+}
+
+#ifndef SOLVER_LIBRARY
+SolveResult solve(const PuzzleInput& input, const Options& options) {
+    switch (input.gridSize) {
+    case 9:
+        return solvePuzzle<Geometry<3>>(input.values, options);
+    case 16:
+        return solvePuzzle<Geometry<4>>(input.values, options);
+    default:
+        return solvePuzzle<Geometry<5>>(input.values, options);
+    }
+}
+
+template <typename G>
+SolveResult solvePuzzle(const vector<uint8_t>& values, const Options& options) {
+    SearchControl control = searchLimits(options);
+    Puzzle<G> puzzle = makePuzzle<G>(values.data(), options.bombsPerUnit);
+    Trail<G> trail;
+    NodeTable nodes(options.counting);
+    size_t otherNodes = 0;
+    bool solved = initialInference(puzzle, trail);
+    if (solved && control.subsetDepth > 0) solved = subsetInference(puzzle, trail);
+    int root = trail.size;
+    if (options.solutionCap > 0)
+        return countSolutions(puzzle, trail, nodes, options, solved, control);
+    else if (solved && options.engine == CDCL)
+        solved = cdclSearch(puzzle, otherNodes, &control);
+    else if (solved && options.parallel)
+        solved = parallelSearch(puzzle, options, nodes, otherNodes, control);
+    else if (solved && options.portfolio)
+        solved = portfolioSearch(puzzle, options, control, otherNodes);
+    else if (solved)
+        solved = backtrackingSearch(puzzle, trail, nodes, &control);
+    // a search that gave up answers with what inference proved, not with the tiles it was trying
+    if (control.gaveUp) undoTo(root, puzzle, trail);
+    size_t nodeCount = totalNodes(nodes, otherNodes);
+    // Testing, left out of batches where the threads would interleave it and of answers going to stdout
+    bool interactive = !options.batch && options.outputPath != "-";
+    if (solved && interactive) cout << endl << puzzleStatus(puzzle) << endl;
+    if (control.gaveUp && interactive) cout << "Gave up after " << nodeCount << " nodes" << endl;
+    if (options.refutationBytes > 0 && interactive) {
+        uint64_t probes = control.refutationProbes;
+        cout << "Refuted states: " << control.refutationHits << " hits in " << probes << " lookups (" << std::fixed
+             << std::setprecision(1) << (probes ? 100.0 * control.refutationHits / probes : 0) << "%)"
+             << std::defaultfloat << endl;
+    }
+    int status = control.gaveUp ? SOLVER_GAVE_UP : solved ? SOLVER_SOLVED : SOLVER_UNSOLVABLE;
+    if (options.format == BINARY_OUTPUT) {
+        return {packAnswer(puzzle, nodeCount, status), nodeCount, solved, control.gaveUp};
+    }
+    return {formatAnswer(puzzle, nodeCount, status), nodeCount, solved, control.gaveUp};
+}
+
+SearchControl searchLimits(const Options& options) {
+    SearchControl control;
+    control.subsetDepth = options.subsetDepth;
+    if (options.nodeBudget > 0) control.nodeLimit = options.nodeBudget;
+    if (options.deadlineMs > 0) {
+        control.deadline = SearchControl::Clock::now() + std::chrono::milliseconds(options.deadlineMs);
+    }
+    return control;
+}
+#endif
+
+SearchControl searchLimits(const SolverConfig& config) {
+    SearchControl control;
+    if (config.nodeBudget > 0) control.nodeLimit = config.nodeBudget;
+    if (config.deadlineMs > 0) {
+        control.deadline = SearchControl::Clock::now() + std::chrono::milliseconds(config.deadlineMs);
+    }
+    return control;
+}
+
+bool isValidPuzzle(const uint8_t* values, int gridSize, int bombsPerUnit) {
+    if (gridSize != 9 && gridSize != 16 && gridSize != 25) return false;
+    if (bombsPerUnit < 0 || bombsPerUnit >= gridSize) return false;
+    for (int tile = 0; tile < gridSize * gridSize; ++tile) {
+        if (values[tile] > 8) return false;
+    }
+    return true;
+}
+
+size_t totalNodes(const NodeTable& nodes, size_t otherNodes) {
+    return nodes.size() + otherNodes;
+}
+
+} // namespace
+
+struct Solver::State {
+    SolverConfig config;
+    Arena arena;
+    NodeTable nodes;
+    int sessionSize = 0;     // grid size of the puzzle loaded for editing, 0 for none
+    void* session = nullptr; // its EditSession, in the arena
+};
+
+Solver::Solver(const SolverConfig& config)
+    : state(new State{config, Arena(), NodeTable(config.countAllNodes ? ALL_NODES : DISTINCT_NODES)}) {}
+Solver::~Solver() = default;
+Solver::Solver(Solver&& other) noexcept = default;
+Solver& Solver::operator=(Solver&& other) noexcept = default;
+
+bool Solver::solve(const uint8_t* values, int gridSize, uint8_t* bombs, SolverResult& result) {
+    result = SolverResult();
+    result.status = SOLVER_INVALID;
+    // the arena is about to be reused
+    state->sessionSize = 0;
+    if (!isValidPuzzle(values, gridSize, state->config.bombsPerUnit)) return false;
+    switch (gridSize) {
+    case 9:
+        return solveInArena<Geometry<3>>(values, state->config, state->arena, state->nodes, bombs, result);
+    case 16:
+        return solveInArena<Geometry<4>>(values, state->config, state->arena, state->nodes, bombs, result);
+    default:
+        return solveInArena<Geometry<5>>(values, state->config, state->arena, state->nodes, bombs, result);
+    }
+}
+
+bool Solver::load(const uint8_t* values, int gridSize, uint8_t* bombs, SolverResult& result) {
+    result = SolverResult();
+    result.status = SOLVER_INVALID;
+    state->sessionSize = 0;
+    if (!isValidPuzzle(values, gridSize, state->config.bombsPerUnit)) return false;
+    State& s = *state;
+    switch (gridSize) {
+    case 9:
+        s.session = loadSession<Geometry<3>>(values, s.config, s.arena, s.nodes, bombs, result);
+        break;
+    case 16:
+        s.session = loadSession<Geometry<4>>(values, s.config, s.arena, s.nodes, bombs, result);
+        break;
+    default:
+        s.session = loadSession<Geometry<5>>(values, s.config, s.arena, s.nodes, bombs, result);
+        break;
+    }
+    s.sessionSize = gridSize;
+    return result.status == SOLVER_SOLVED;
+}
+
+bool Solver::edit(int tile, int edit, int number, uint8_t* bombs, SolverResult& result) {
+    result = SolverResult();
+    result.status = SOLVER_INVALID;
+    State& s = *state;
+    switch (s.sessionSize) {
+    case 9:
+        return editSession(*static_cast<EditSession<Geometry<3>>*>(s.session), tile, edit, number, s.config, s.nodes,
+                           bombs, result);
+    case 16:
+        return editSession(*static_cast<EditSession<Geometry<4>>*>(s.session), tile, edit, number, s.config, s.nodes,
+                           bombs, result);
+    case 25:
+        return editSession(*static_cast<EditSession<Geometry<5>>*>(s.session), tile, edit, number, s.config, s.nodes,
+                           bombs, result);
+    default:
+        return false;
+    }
+}
+
+namespace {
+
+template <typename G>
+bool solveInArena(const uint8_t* values, const SolverConfig& config, Arena& arena, NodeTable& nodes, uint8_t* bombs,
+                  SolverResult& result) {
+    arena.reset(Arena::bytesFor<Puzzle<G>, Trail<G>>());
+    Puzzle<G>& puzzle = *arena.allocate<Puzzle<G>>();
+    Trail<G>& trail = *arena.allocate<Trail<G>>();
+    puzzle = makePuzzle<G>(values, config.bombsPerUnit);
+    nodes.clear();
+    SearchControl control = searchLimits(config);
+    bool consistent = initialInference(puzzle, trail);
+    return finishSolve(puzzle, trail, consistent, config, nodes, control, bombs, result);
+}
+
+template <typename G>
+bool finishSolve(Puzzle<G>& puzzle, Trail<G>& trail, bool consistent, const SolverConfig& config, NodeTable& nodes,
+                 SearchControl& control, uint8_t* bombs, SolverResult& result) {
+    size_t otherNodes = 0;
+    int root = trail.size;
+    bool solved = consistent;
+    if (solved && config.cdcl)
+        solved = cdclSearch(puzzle, otherNodes, &control);
+    else if (solved)
+        solved = backtrackingSearch(puzzle, trail, nodes, &control);
+    if (control.gaveUp) undoTo(root, puzzle, trail);
+    result.status = control.gaveUp ? SOLVER_GAVE_UP : solved ? SOLVER_SOLVED : SOLVER_UNSOLVABLE;
+    result.goalDepth = getGoalDepth(puzzle);
+    result.nodes = totalNodes(nodes, otherNodes);
+    for (int tile = 0; tile < G::CELLS; ++tile) bombs[tile] = puzzle.bombs.test(tile);
+    return solved;
+}
+
+template <typename G>
+EditSession<G>* loadSession(const uint8_t* values, const SolverConfig& config, Arena& arena, NodeTable& nodes,
+                            uint8_t* bombs, SolverResult& result) {
+    arena.reset(Arena::bytesFor<EditSession<G>>());
+    EditSession<G>& session = *arena.allocate<EditSession<G>>();
+    std::copy(values, values + G::CELLS, session.values);
+    std::fill(session.pins, session.pins + G::CELLS, 0);
+    resolveSession(session, config, nodes, bombs, result);
+    return &session;
+}
+
+template <typename G>
+bool editSession(EditSession<G>& session, int tile, int edit, int number, const SolverConfig& config,
+                 NodeTable& nodes, uint8_t* bombs, SolverResult& result) {
+    if (tile < 0 || tile >= G::CELLS || edit < SOLVER_CLEAR || edit > SOLVER_PIN_EMPTY) return false;
+    if (edit == SOLVER_CLUE && (number < 1 || number > 8)) return false;
+    uint8_t value = edit == SOLVER_CLUE ? number : 0;
+    uint8_t pin = edit == SOLVER_PIN_BOMB ? 1 : edit == SOLVER_PIN_EMPTY ? 2 : 0;
+    // Only a free tile, an unchanged one or an empty one being numbered takes no constraint away. Anything else may
+    // make what the root inferred wrong.
+    bool tightens = (session.values[tile] == 0 && session.pins[tile] == 0) ||
+                    (session.values[tile] == value && session.pins[tile] == pin) || (session.pins[tile] == 2 && value);
+    session.values[tile] = value;
+    session.pins[tile] = pin;
+    if (!tightens) session.rootValid = false;
+    // The last solution found stands if it keeps every constraint. While it is the answer, every constraint but the
+    // one on this tile is known to hold. An older one has to be checked in full, as after undoing an edit.
+    bool kept = session.hasSolution && solutionKeepsTile(session, tile);
+    if (kept && session.status != SOLVER_SOLVED) {
+        kept = solutionKeepsAll(session, config.bombsPerUnit > 0 ? config.bombsPerUnit : G::DEFAULT_BOMBS_PER_UNIT);
+    }
+    // and an unsolvable puzzle stays that way under more constraints
+    if (!kept && !(session.status == SOLVER_UNSOLVABLE && tightens)) {
+        return resolveSession(session, config, nodes, bombs, result);
+    }
+    if (kept) session.status = SOLVER_SOLVED;
+    result.status = session.status;
+    result.goalDepth = std::count(session.values, session.values + G::CELLS, 0);
+    result.nodes = 0;
+    for (int index = 0; index < G::CELLS; ++index) bombs[index] = kept && session.solution[index];
+    return kept;
+}
 
-// returns a box from 0-8 using coords
-int getBoxFromCoords(int row, int col);
+template <typename G>
+bool solutionKeepsTile(const EditSession<G>& session, int tile) {
+    if (session.pins[tile]) return session.solution[tile] == (session.pins[tile] == 1);
+    if (!session.values[tile]) return true;
+    const Masks<G>& masks = MASKS<G>;
+    int adjacentBombs = 0;
+    for (int index = 0; index < masks.neighbourCount[tile]; ++index) {
+        adjacentBombs += session.solution[masks.neighbourList[tile][index]];
+    }
+    return !session.solution[tile] && adjacentBombs == session.values[tile];
+}
 
-// returns a pair of coords to start from based on a box
-Pair getStartCoordsFromBox(int box);
+template <typename G>
+bool solutionKeepsAll(const EditSession<G>& session, int bombsPerUnit) {
+    typename G::Bits bombs;
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        if (!solutionKeepsTile(session, tile)) return false;
+        if (session.solution[tile]) bombs |= G::Bits::bit(tile);
+    }
+    for (int unit = 0; unit < G::UNITS; ++unit) {
+        if (popcount(MASKS<G>.units[unit] & bombs) != bombsPerUnit) return false;
+    }
+    return true;
+}
 
-// takes a pair of coordinates and
-// returns how many non-number tiles adjacent to the coordinate
-int degreeHeuristic(int row, int col, vector<vector<Tile*>>& puzzle);
+template <typename G>
+bool resolveSession(EditSession<G>& session, const SolverConfig& config, NodeTable& nodes, uint8_t* bombs,
+                    SolverResult& result) {
+    using Bits = typename G::Bits;
+    Puzzle<G>& puzzle = session.puzzle;
+    Trail<G>& trail = session.trail;
+    puzzle = makePuzzle<G>(session.values, config.bombsPerUnit);
+    trail.size = 0;
+    // pins, and while the root is valid everything it ruled out, narrow the domains before inference
+    Bits notBomb;
+    Bits notEmpty;
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        if (session.pins[tile] == 1) notEmpty |= Bits::bit(tile);
+        if (session.pins[tile] == 2) notBomb |= Bits::bit(tile);
+    }
+    if (session.rootValid) {
+        const Puzzle<G>& root = session.root;
+        Bits open = unassignedTiles(root);
+        notBomb |= ~(root.bombs | (open & root.canBeBomb));
+        notEmpty |= ~(root.empties | (open & root.canBeEmpty));
+    }
+    removeFromDomain(notBomb, CAN_BE_BOMB, puzzle, trail);
+    removeFromDomain(notEmpty, CAN_BE_EMPTY, puzzle, trail);
+    nodes.clear();
+    SearchControl control = searchLimits(config);
+    control.phases = session.hasSolution ? session.solution : nullptr;
+    session.rootValid = initialInference(puzzle, trail);
+    if (session.rootValid) session.root = puzzle;
+    bool solved = finishSolve(puzzle, trail, session.rootValid, config, nodes, control, bombs, result);
+    session.status = result.status;
+    if (solved) {
+        std::copy(bombs, bombs + G::CELLS, session.solution);
+        session.hasSolution = true;
+    }
+    return solved;
+}
 
-// takes a tile and returns number
-// of possibilities that tile has (bomb or not bomb)
-int mrv(Tile& tile);
+} // namespace
 
-Pair getCoordsOfTile(const Tile* tile, vector<vector<Tile*>> puzzle);
+struct SolverHandle {
+    Solver solver;
+};
 
-// checks if a numbered tile is consistent with its surrounding tiles
-bool isNumberedTileConsistent(int row, int col, vector<vector<Tile*>>& puzzle);
+SolverHandle* solverCreate(const SolverConfig* config) {
+    return new (std::nothrow) SolverHandle{Solver(config ? *config : SolverConfig())};
+}
 
-// Reads the input and creates a 2D vector representing the puzzle
-vector<vector<Tile*>> readPuzzle(const string& filePath);
+void solverDestroy(SolverHandle* solver) {
+    delete solver;
+}
 
-void writeAnswer(vector<vector<Tile*>>& puzzle, unordered_set<string>& nodes);
+int solverSolve(SolverHandle* solver, const uint8_t* values, int gridSize, uint8_t* bombs, SolverResult* result) {
+    SolverResult ignored;
+    solver->solver.solve(values, gridSize, bombs, result ? *result : ignored);
+    return (result ? *result : ignored).status;
+}
 
-bool backtrackingSearch(vector<vector<Tile*>>& puzzle, unordered_set<string>& nodes);
+int solverLoad(SolverHandle* solver, const uint8_t* values, int gridSize, uint8_t* bombs, SolverResult* result) {
+    SolverResult ignored;
+    solver->solver.load(values, gridSize, bombs, result ? *result : ignored);
+    return (result ? *result : ignored).status;
+}
 
-bool isInRow(int row, int col, int newRow, int newCol);
+int solverEdit(SolverHandle* solver, int tile, int edit, int number, uint8_t* bombs, SolverResult* result) {
+    SolverResult ignored;
+    solver->solver.edit(tile, edit, number, bombs, result ? *result : ignored);
+    return (result ? *result : ignored).status;
+}
 
-bool isInCol(int row, int col, int newRow, int newCol);
+namespace {
 
-bool isInBox(int row, int col, int newRow, int newCol);
+#ifndef SOLVER_LIBRARY
+template <typename G>
+SolveResult countSolutions(Puzzle<G>& puzzle, Trail<G>& trail, NodeTable& nodes, const Options& options,
+                           bool consistent, SearchControl& control) {
+    std::unique_ptr<SolutionCount<G>> solutions(new SolutionCount<G>());
+    solutions->cap = options.solutionCap;
+    int root = trail.size;
+    if (consistent) backtrackingSearch(puzzle, trail, nodes, &control, solutions.get());
+    if (solutions->count > 0)
+        puzzle = solutions->first;
+    else if (control.gaveUp)
+        undoTo(root, puzzle, trail);
+    if (!options.batch && options.outputPath != "-") {
+        cout << solutions->count << " solution(s)" << (control.gaveUp ? " before giving up" : "") << endl;
+    }
+    int status = control.gaveUp ? SOLVER_GAVE_UP : solutions->count > 0 ? SOLVER_SOLVED : SOLVER_UNSOLVABLE;
+    string answer = formatAnswer(puzzle, nodes.size(), status) + std::to_string(solutions->count) + "\n";
+    return {answer, nodes.size(), solutions->count > 0, control.gaveUp};
+}
 
-// Inference functions
-bool forwardChecking(int row, int col, vector<vector<Tile*>>& puzzle);
+template <typename G>
+size_t solutionCount(const vector<uint8_t>& values, int bombsPerUnit, size_t cap, NodeTable& nodes,
+                     size_t nodeBudget) {
+    Puzzle<G> puzzle = makePuzzle<G>(values.data(), bombsPerUnit);
+    std::unique_ptr<Trail<G>> trail(new Trail<G>());
+    if (!initialInference(puzzle, *trail)) return 0;
+    std::unique_ptr<SolutionCount<G>> solutions(new SolutionCount<G>());
+    solutions->cap = cap;
+    SearchControl control;
+    control.nodeLimit = nodeBudget == SIZE_MAX ? SIZE_MAX : nodes.size() + nodeBudget;
+    backtrackingSearch(puzzle, *trail, nodes, &control, solutions.get());
+    return control.gaveUp ? cap : solutions->count;
+}
 
-// Forward checks all the tiles in the row, column, and box. If forward check fails, all tiles domains stay the
-// same. If forward check succeeds, tile domains get updated
-bool forwardCheckRow(int row, int col, vector<vector<Tile*>>& puzzle);
-bool forwardCheckCol(int row, int col, vector<vector<Tile*>>& puzzle);
-bool forwardCheckBox(int row, int col, vector<vector<Tile*>>& puzzle);
+bool generatePuzzles(const Options& options) {
+    switch (options.gridSize) {
+    case 9:
+        return generatePuzzlesOfSize<Geometry<3>>(options);
+    case 16:
+        return generatePuzzlesOfSize<Geometry<4>>(options);
+    default:
+        return generatePuzzlesOfSize<Geometry<5>>(options);
+    }
+}
 
-// Checks if a specific numbered tile needs to update domains of the tiles around it
-bool forwardCheckNumberedTile(int row, int col, vector<vector<Tile*>>& puzzle);
-// Checks all numbered tiles around a newly assigned tile and forward checks each individual tile with function
-// above.
-bool forwardCheckNumberedTiles(int row, int col, vector<vector<Tile*>>& puzzle);
+template <typename G>
+bool generatePuzzlesOfSize(const Options& options) {
+    int bombsPerUnit = options.bombsPerUnit > 0 ? options.bombsPerUnit : G::DEFAULT_BOMBS_PER_UNIT;
+    std::atomic<size_t> claimed(0);
+    std::atomic<bool> outOfReach(false);
+    std::mutex outputMutex;
+    auto worker = [&](size_t self) {
+        std::mt19937_64 random(options.seed + self);
+        vector<uint8_t> values;
+        while (options.puzzleCount == 0 || claimed++ < options.puzzleCount) {
+            // keep sampling until a layout gives a unique puzzle that is hard enough, or every worker gives up
+            NodeTable grade;
+            for (size_t attempt = 0;; ++attempt) {
+                if (outOfReach) return;
+                if (attempt == GENERATOR_ATTEMPTS) {
+                    outOfReach = true;
+                    return;
+                }
+                if (!makeUniquePuzzle<G>(sampleLayout<G>(bombsPerUnit, random), bombsPerUnit, random, values)) continue;
+                grade = NodeTable(DISTINCT_NODES);
+                // a grading solve gives up one node past the hardest puzzle wanted, which the range below rejects
+                size_t gradeBudget = options.maxDifficulty == SIZE_MAX ? SIZE_MAX : options.maxDifficulty + 1;
+                solutionCount<G>(values, bombsPerUnit, 1, grade, gradeBudget);
+                if (grade.size() >= options.minDifficulty && grade.size() <= options.maxDifficulty) break;
+            }
+            string text = "# nodes " + std::to_string(grade.size()) + "\n";
+            for (int row = 0; row < G::GRID_SIZE; ++row) {
+                for (int col = 0; col < G::GRID_SIZE; ++col) {
+                    text += std::to_string(values[row * G::GRID_SIZE + col]);
+                    text += col + 1 < G::GRID_SIZE ? " " : "\n";
+                }
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            cout << text << endl;
+        }
+    };
+    size_t threadCount = workerCount(options, options.puzzleCount > 0 ? options.puzzleCount : SIZE_MAX);
+    vector<std::thread> pool;
+    for (size_t thread = 1; thread < threadCount; ++thread) pool.emplace_back(worker, thread);
+    worker(0);
+    for (std::thread& thread : pool) thread.join();
+    return !outOfReach;
+}
 
-// chooses the next best tile
-Tile* selectUnassignedVariable(vector<vector<Tile*>>& puzzle);
+template <typename G>
+vector<uint8_t> sampleLayout(int bombsPerUnit, std::mt19937_64& random) {
+    // rows or columns in a random order that keeps each band or stack together
+    auto shuffledLines = [&]() {
+        vector<int> bands(G::BOX_SIZE), lines;
+        std::iota(bands.begin(), bands.end(), 0);
+        std::shuffle(bands.begin(), bands.end(), random);
+        for (int band : bands) {
+            vector<int> inner(G::BOX_SIZE);
+            std::iota(inner.begin(), inner.end(), band * G::BOX_SIZE);
+            std::shuffle(inner.begin(), inner.end(), random);
+            lines.insert(lines.end(), inner.begin(), inner.end());
+        }
+        return lines;
+    };
+    vector<int> rows = shuffledLines();
+    vector<int> cols = shuffledLines();
+    vector<int> symbols(G::GRID_SIZE);
+    std::iota(symbols.begin(), symbols.end(), 0);
+    std::shuffle(symbols.begin(), symbols.end(), random);
+    bool transpose = random() & 1;
+    vector<uint8_t> layout(G::CELLS);
+    for (int row = 0; row < G::GRID_SIZE; ++row) {
+        for (int col = 0; col < G::GRID_SIZE; ++col) {
+            int patternRow = transpose ? cols[col] : rows[row];
+            int patternCol = transpose ? rows[row] : cols[col];
+            // every symbol of the pattern is once in each unit, so bombsPerUnit of them give a valid layout
+            int symbol =
+                (G::BOX_SIZE * (patternRow % G::BOX_SIZE) + patternRow / G::BOX_SIZE + patternCol) % G::GRID_SIZE;
+            layout[row * G::GRID_SIZE + col] = symbols[symbol] < bombsPerUnit;
+        }
+    }
+    return layout;
+}
 
-// sees if there are any unassigned tiles in the puzzle
-bool isPuzzleComplete(vector<vector<Tile*>>& puzzle);
+template <typename G>
+bool makeUniquePuzzle(const vector<uint8_t>& layout, int bombsPerUnit, std::mt19937_64& random,
+                      vector<uint8_t>& values) {
+    const Masks<G>& masks = MASKS<G>;
+    values.assign(G::CELLS, 0);
+    vector<int> clues;
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        if (layout[tile]) continue;
+        for (int i = 0; i < masks.neighbourCount[tile]; ++i) values[tile] += layout[masks.neighbourList[tile][i]];
+        if (values[tile] > 0) clues.push_back(tile);
+    }
+    // uniqueness checks only need a count, not the distinct nodes
+    NodeTable nodes(ALL_NODES);
+    if (solutionCount<G>(values, bombsPerUnit, 2, nodes, GENERATOR_CHECK_NODES) != 1) return false;
+    std::shuffle(clues.begin(), clues.end(), random);
+    for (int tile : clues) {
+        int clue = values[tile];
+        values[tile] = 0;
+        // a clue whose removal can't be proven safe within the budget stays
+        if (solutionCount<G>(values, bombsPerUnit, 2, nodes, GENERATOR_CHECK_NODES) != 1) values[tile] = clue;
+    }
+    return true;
+}
 
-// Copy functions for the puzzle, used in places where we may need to revert changes
-vector<vector<Tile>> makeCopy(vector<vector<Tile*>>& puzzle);
-void copyPuzzle(vector<vector<Tile*>>& puzzle, vector<vector<Tile>>& copy);
+void solveBatch(const PuzzleSet& puzzles, const Options& options, ResultWriter& writer) {
+    vector<string> answers(puzzles.size());
+    vector<char> done(puzzles.size());
+    size_t written = 0;
+    std::mutex writerMutex;
+    // every worker claims the next unsolved puzzle, so a slow puzzle never holds up the others
+    std::atomic<size_t> next(0);
+    auto deliver = [&](size_t index, string answer) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        answers[index] = std::move(answer);
+        done[index] = true;
+        // whoever finishes the oldest outstanding puzzle writes out the run of answers that is now in order
+        for (; written < puzzles.size() && done[written]; ++written) {
+            if (written > 0 && options.format == TEXT_OUTPUT) writer.write("\n");
+            writer.write(answers[written]);
+            string().swap(answers[written]);
+        }
+    };
+    auto worker = [&]() {
+        if (!options.lockstep) {
+            PuzzleInput input;
+            for (size_t index = next++; index < puzzles.size(); index = next++) {
+                puzzles.decode(index, input);
+                deliver(index, solve(input, options).answer);
+            }
+        } else if (puzzles.size() > 0 && puzzles.gridSize(0) == 9) {
+            lockstepBatch<Geometry<3>>(puzzles, options, next, deliver);
+        } else if (puzzles.size() > 0 && puzzles.gridSize(0) == 16) {
+            lockstepBatch<Geometry<4>>(puzzles, options, next, deliver);
+        } else {
+            lockstepBatch<Geometry<5>>(puzzles, options, next, deliver);
+        }
+        STATS_MERGE();
+    };
+    vector<std::thread> pool;
+    for (size_t thread = 1; thread < workerCount(options, puzzles.size()); ++thread) pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool) thread.join();
+}
 
-// Testing function that prints out the layout of the puzzle
-string puzzleStatus(const vector<vector<Tile*>>& puzzle);
+int runBenchmark(const Options& options) {
+    using Clock = std::chrono::steady_clock;
+    // solve like a batch so that no solution gets printed
+    Options solveOptions = options;
+    solveOptions.batch = true;
+    std::ostringstream results;
+    results << std::fixed << std::setprecision(4);
+    results << "{\n";
+    results << "  \"engine\": \"" << (options.engine == CDCL ? "cdcl" : options.parallel ? "parallel" : "backtracking")
+            << "\",\n";
+    results << "  \"warmup\": " << options.warmup << ",\n";
+    results << "  \"trials\": " << options.trials << ",\n";
+    results << "  \"corpora\": [";
+    cout << std::fixed << std::setprecision(4);
+    vector<string> corpora = listPuzzleFiles(options.filePath);
+    for (size_t corpus = 0; corpus < corpora.size(); ++corpus) {
+        PuzzleSet set;
+        if (!readPuzzleFile(corpora[corpus], set)) return 1;
+        // decoded up front, so that the timings are of the solver alone
+        vector<PuzzleInput> puzzles(set.size());
+        for (size_t index = 0; index < set.size(); ++index) {
+            if (!isSolvable(set.gridSize(index), options)) return 1;
+            set.decode(index, puzzles[index]);
+        }
+        for (int pass = 0; pass < options.warmup; ++pass) {
+            for (const PuzzleInput& input : puzzles) solve(input, solveOptions);
+        }
+        vector<double> latencies; // milliseconds
+        size_t nodes = 0;
+        size_t solved = 0;
+        double seconds = 0;
+        for (int trial = 0; trial < options.trials; ++trial) {
+            for (const PuzzleInput& input : puzzles) {
+                Clock::time_point start = Clock::now();
+                SolveResult result = solve(input, solveOptions);
+                double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+                latencies.push_back(1000 * elapsed);
+                seconds += elapsed;
+                nodes += result.nodes;
+                solved += result.solved;
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        // nearest rank percentile
+        auto percentile = [&](double fraction) {
+            size_t rank = std::ceil(fraction * latencies.size());
+            return latencies[std::max<size_t>(rank, 1) - 1];
+        };
+        string name = std::filesystem::path(corpora[corpus]).stem().string();
+        // node and solution counts are per trial so that they stay the same from run to run
+        results << (corpus > 0 ? "," : "") << "\n    {\n";
+        results << "      \"name\": \"" << name << "\",\n";
+        results << "      \"puzzles\": " << puzzles.size() << ",\n";
+        results << "      \"solved\": " << solved / options.trials << ",\n";
+        results << "      \"nodes\": " << nodes / options.trials << ",\n";
+        results << "      \"puzzles_per_sec\": " << latencies.size() / seconds << ",\n";
+        results << "      \"nodes_per_sec\": " << nodes / seconds << ",\n";
+        results << "      \"p50_ms\": " << percentile(0.5) << ",\n";
+        results << "      \"p99_ms\": " << percentile(0.99) << ",\n";
+        results << "      \"max_ms\": " << latencies.back() << "\n";
+        results << "    }";
+        cout << name << ": " << puzzles.size() << " puzzles, " << nodes / options.trials << " nodes, "
+             << latencies.size() / seconds << " puzzles/s, " << nodes / seconds << " nodes/s, p50 "
+             << percentile(0.5) << " ms, p99 " << percentile(0.99) << " ms, max " << latencies.back() << " ms"
+             << endl;
+    }
+    results << "\n  ]\n}\n";
+    ofstream resultsFile(options.resultsPath);
+    resultsFile << results.str();
+    return 0;
+}
 
-// Generates a unique key for the current puzzle formation
-string makeKey(const vector<vector<Tile*>>& puzzle);
+int runServer(const Options& options) {
+    // a client that hangs up early must not take the server down with it
+    std::signal(SIGPIPE, SIG_IGN);
+    SolverConfig config = {options.bombsPerUnit, options.counting == ALL_NODES, options.engine == CDCL,
+                           options.nodeBudget, options.deadlineMs};
+    BlockingQueue<ServerJob> jobs;
+    std::unique_ptr<SolutionCache> cache;
+    if (options.cacheEntries > 0) cache.reset(new SolutionCache(options.cacheEntries));
+    auto worker = [&]() {
+        Solver solver(config);
+        PuzzleInput puzzle;
+        vector<uint8_t> bombs(Geometry<5>::CELLS);
+        ServerJob job;
+        while (jobs.pop(job)) {
+            job.connection->finish(job.request, answerRequest(job.line, solver, cache.get(), puzzle, bombs));
+            // the last job of a closed connection closes its socket
+            job.connection.reset();
+        }
+        STATS_MERGE();
+    };
+    vector<std::thread> pool;
+    for (size_t thread = 0; thread < workerCount(options, SIZE_MAX); ++thread) pool.emplace_back(worker);
+    int status = 0;
+    if (options.socketPath.empty()) {
+        readRequests(std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false), jobs);
+    } else {
+        int listener = listenOn(options.socketPath);
+        if (listener < 0) {
+            cout << "Cannot serve on " << options.socketPath << ": " << std::strerror(errno) << endl;
+            status = 1;
+        } else {
+            cout << "Serving on " << options.socketPath << endl;
+        }
+        while (status == 0) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0 && (errno == EINTR || errno == ECONNABORTED)) continue;
+            if (client < 0) {
+                cout << "Cannot accept on " << options.socketPath << ": " << std::strerror(errno) << endl;
+                status = 1;
+                break;
+            }
+            std::thread(readRequests, std::make_shared<Connection>(client, client, true), std::ref(jobs)).detach();
+        }
+        if (listener >= 0) close(listener);
+    }
+    jobs.close();
+    for (std::thread& thread : pool) thread.join();
+    return status;
+}
 
-// Gets the goal depth of the puzzle by counting how many 0s
-int getGoalDepth(const vector<vector<Tile*>>& puzzle);
+int listenOn(const string& socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    // a socket file left behind by an earlier server is replaced, anything else at the path is left alone
+    struct stat info;
+    if (lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) unlink(socketPath.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return -1;
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 128) < 0) {
+        int error = errno;
+        close(listener);
+        errno = error;
+        return -1;
+    }
+    return listener;
+}
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        cout << "Run ./solve.o fileName (e.g. ./solve.o input.txt)" << endl;
-        return 1;
+void readRequests(std::shared_ptr<Connection> connection, BlockingQueue<ServerJob>& jobs) {
+    string pending;
+    char chunk[1 << 16];
+    bool more = true;
+    while (more) {
+        ssize_t count = read(connection->input(), chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) continue;
+        more = count > 0;
+        if (more) pending.append(chunk, count);
+        // the end of input also ends a last line without a line break
+        if (!more && !pending.empty() && pending.back() != '\n') pending += '\n';
+        size_t start = 0;
+        for (size_t end; (end = pending.find('\n', start)) != string::npos; start = end + 1) {
+            size_t length = end - start;
+            if (length > 0 && pending[end - 1] == '\r') --length;
+            // blank lines and comments get no response
+            if (length == 0 || pending[start] == '#') continue;
+            jobs.push({connection, connection->expect(), pending.substr(start, length)});
+        }
+        pending.erase(0, start);
     }
-    vector<vector<Tile*>> puzzle = readPuzzle(argv[1]);
-    unordered_set<string> nodes;
-    backtrackingSearch(puzzle, nodes);
-    writeAnswer(puzzle, nodes);
+    connection->close();
 }
 
-vector<vector<Tile*>> readPuzzle(const string& filePath) {
-    fstream fd(filePath);
-    vector<vector<Tile*>> result;
-    if (!fd.is_open()) {
-        cout << "Invalid file " << filePath << endl;
-        return result;
+string canonicalKey(const vector<uint8_t>& values, int gridSize, int& symmetry) {
+    int tiles = gridSize * gridSize;
+    vector<uint8_t> best;
+    vector<uint8_t> variant(tiles);
+    for (int candidate = 0; candidate < SYMMETRIES; ++candidate) {
+        for (int tile = 0; tile < tiles; ++tile) variant[transformTile(tile, gridSize, candidate)] = values[tile];
+        if (best.empty() || variant < best) {
+            best = variant;
+            symmetry = candidate;
+        }
     }
-    char c;
-    vector<Tile*> row;
-    while (fd >> c) {
-        if (c >= '0' && c <= '8') {
-            Tile* newTile = new Tile{.num = c - '0'};
-            newTile->num == 0 ? newTile->assignment = UNASSIGNED : newTile->assignment = EMPTY;
-            row.push_back(newTile);
+    // clues only go up to 8, so two fit in a byte
+    string key((tiles + 1) / 2, '\0');
+    for (int tile = 0; tile < tiles; ++tile) key[tile / 2] |= char(best[tile] << (tile % 2 * 4));
+    return key;
+}
+
+string answerRequest(const string& line, Solver& solver, SolutionCache* cache, PuzzleInput& puzzle,
+                     vector<uint8_t>& bombs) {
+    if (line == "cache") return cache ? "cache " + cache->counters() + "\n" : "error the cache is off\n";
+    string error = parseCompactRecord(line.data(), line.size(), puzzle);
+    if (!error.empty()) return "error " + error + "\n";
+    int tiles = puzzle.values.size();
+    int symmetry = 0;
+    string key;
+    CachedSolution cached;
+    SolverResult result;
+    bool solved;
+    if (cache) key = canonicalKey(puzzle.values, puzzle.gridSize, symmetry);
+    if (cache && cache->find(key, cached)) {
+        // the canonical variant's bombs, mapped back onto this puzzle
+        for (int tile = 0; tile < tiles; ++tile) {
+            bombs[tile] = cached.bombs[transformTile(tile, puzzle.gridSize, symmetry)];
         }
-        if (row.size() == 9) {
-            result.push_back(row);
-            row = {};
+        result.status = cached.status;
+        result.goalDepth = cached.goalDepth;
+        result.nodes = 0;
+        solved = cached.status == SOLVER_SOLVED;
+    } else {
+        solved = solver.solve(puzzle.values.data(), puzzle.gridSize, bombs.data(), result);
+        if (cache && result.status != SOLVER_INVALID && result.status != SOLVER_GAVE_UP) {
+            cached.status = result.status;
+            cached.goalDepth = result.goalDepth;
+            cached.bombs = vector<uint8_t>(puzzle.values.size());
+            for (size_t tile = 0; tile < cached.bombs.size(); ++tile) {
+                cached.bombs[transformTile(tile, puzzle.gridSize, symmetry)] = bombs[tile];
+            }
+            cache->insert(key, std::move(cached));
         }
     }
-    return result;
+    if (result.status == SOLVER_INVALID) {
+        return "error a " + std::to_string(puzzle.gridSize) + "x" + std::to_string(puzzle.gridSize) +
+               " grid needs fewer bombs per unit\n";
+    }
+    const char* outcome = solved ? "solved " : result.status == SOLVER_GAVE_UP ? "gaveup " : "unsolvable ";
+    string response = outcome + std::to_string(result.goalDepth) + " " + std::to_string(result.nodes);
+    if (solved) {
+        response += ' ';
+        for (size_t tile = 0; tile < puzzle.values.size(); ++tile) response += char('0' + bombs[tile]);
+    }
+    return response + "\n";
 }
 
-bool isInGrid(int row, int col) {
-    return !(row < 0 || row > 8 || col < 0 || col > 8);
+size_t workerCount(const Options& options, size_t work) {
+    size_t threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    return std::max<size_t>(1, std::min(threads, work));
 }
 
-int degreeHeuristic(int row, int col, vector<vector<Tile*>>& puzzle) {
-    if (!isInGrid(row, col)) return -1;
-    int unassignedVariables = 0;
+template <typename G>
+bool parallelSearch(Puzzle<G>& puzzle, const Options& options, NodeTable& splitNodes, size_t& workerNodes,
+                    SearchControl& control) {
+    size_t threadCount = workerCount(options, SIZE_MAX);
+    // a few subproblems per thread so that stealing can even out subtrees of very different sizes
+    vector<Puzzle<G>> tasks;
+    if (splitSearch(puzzle, 8 * threadCount, tasks, splitNodes)) return true;
+    if (tasks.empty()) return false;
+    threadCount = std::min(threadCount, tasks.size());
+    // deal the subproblems out so that each worker starts on the earliest of its share
+    vector<WorkDeque<Puzzle<G>>> deques(threadCount);
+    for (size_t task = tasks.size(); task-- > 0;) deques[task % threadCount].push(std::move(tasks[task]));
+    tasks.clear();
 
-    // unassigned variables in the row
-    for (size_t newCol = 0; newCol < puzzle.size(); ++newCol) {
-        if (newCol == col) continue;
-        if (puzzle[row][newCol]->assignment == UNASSIGNED) {
-            ++unassignedVariables;
+    std::atomic<bool> solved(false);
+    std::atomic<bool> gaveUp(false);
+    std::atomic<size_t> nodeCount(0);
+    std::mutex solutionMutex;
+    auto worker = [&](size_t self) {
+        // every worker searches its own copy of the state, so the trail is private too
+        std::unique_ptr<Trail<G>> trail(new Trail<G>());
+        NodeTable nodes(options.counting);
+        SearchControl workerControl = control;
+        workerControl.cancelled = &solved;
+        Puzzle<G> task;
+        while (!solved.load(std::memory_order_relaxed) && !workerControl.gaveUp) {
+            bool found = deques[self].pop(task);
+            for (size_t other = 1; !found && other < threadCount; ++other) {
+                found = deques[(self + other) % threadCount].steal(task);
+            }
+            // subproblems are only made up front, so once every deque is empty there is nothing left to do
+            if (!found) break;
+            trail->size = 0;
+            if (!backtrackingSearch(task, *trail, nodes, &workerControl)) continue;
+            // the first solution found cancels every other worker
+            std::lock_guard<std::mutex> lock(solutionMutex);
+            if (!solved.exchange(true)) puzzle = task;
         }
-    }
+        if (workerControl.gaveUp) gaveUp = true;
+        nodeCount += nodes.size();
+        STATS_MERGE();
+    };
+    vector<std::thread> pool;
+    for (size_t thread = 1; thread < threadCount; ++thread) pool.emplace_back(worker, thread);
+    worker(0);
+    for (std::thread& thread : pool) thread.join();
+    workerNodes += nodeCount;
+    // workers that were cancelled by a solution gave up too, which does not count
+    control.gaveUp = !solved && gaveUp;
+    return solved;
+}
 
-    // unassigned variables in the column
-    for (size_t newRow = 0; newRow < puzzle.size(); ++newRow) {
-        if (newRow == row) continue;
-        if (puzzle[newRow][col]->assignment == UNASSIGNED) {
-            ++unassignedVariables;
+template <typename G>
+bool portfolioSearch(Puzzle<G>& puzzle, const Options& options, SearchControl& control, size_t& nodes) {
+    size_t memberCount = workerCount(options, SIZE_MAX);
+    std::atomic<bool> finished(false);
+    std::mutex resultMutex;
+    bool solved = false;
+    size_t memberNodes[2] = {}; // the nodes of the winner, or of the plain search if nobody wins
+    auto member = [&](size_t self) {
+        Puzzle<G> mine = puzzle;
+        std::unique_ptr<Trail<G>> trail(new Trail<G>());
+        NodeTable table(options.counting);
+        SearchControl memberControl = control;
+        memberControl.cancelled = &finished;
+        memberControl.bombFirst = self % 2 == 1;
+        // a chronological search never reaches a state twice, but restarts come back to the states earlier runs
+        // refuted, which the table lets them skip
+        std::unique_ptr<RefutationTable> refuted;
+        bool found;
+        if (self < 2) {
+            found = backtrackingSearch(mine, *trail, table, &memberControl);
+        } else {
+            if (options.refutationBytes > 0) {
+                refuted.reset(new RefutationTable(options.refutationBytes));
+                memberControl.refuted = refuted.get();
+            }
+            // any nonzero seed will do, the multiplier spreads consecutive members apart
+            memberControl.random = (options.seed + self) * 0x9e3779b97f4a7c15 | 1;
+            found = restartingSearch(mine, *trail, table, memberControl, 32);
         }
-    }
+        STATS_MERGE();
+        std::lock_guard<std::mutex> lock(resultMutex);
+        if (refuted) {
+            control.refutationProbes += refuted->probes;
+            control.refutationHits += refuted->hits;
+        }
+        if (self == 0 && !finished) memberNodes[1] = table.size();
+        // a member that gave up was either beaten or ran out of time, so it has nothing to report
+        if (memberControl.gaveUp || finished.exchange(true)) return;
+        solved = found;
+        if (found) puzzle = mine;
+        memberNodes[0] = table.size();
+    };
+    vector<std::thread> pool;
+    for (size_t thread = 1; thread < memberCount; ++thread) pool.emplace_back(member, thread);
+    member(0);
+    for (std::thread& thread : pool) thread.join();
+    control.gaveUp = !finished;
+    nodes += finished ? memberNodes[0] : memberNodes[1];
+    return solved;
+}
 
-    // unassigned variables in the box
-    int box = getBoxFromCoords(row, col);
-    Pair startCoords = getStartCoordsFromBox(box);
-    for (size_t newRow = startCoords.row; newRow < startCoords.row + 3; ++newRow) {
-        for (size_t newCol = startCoords.col; newCol < startCoords.col + 3; ++newCol) {
-            // prevents recounting variables in the same row, column, and also the current tile
-            if (newRow == row || newCol == col) continue;
-            if (puzzle[newRow][col]->assignment == UNASSIGNED) {
-                ++unassignedVariables;
+template <typename G>
+bool splitSearch(Puzzle<G>& puzzle, size_t target, vector<Puzzle<G>>& tasks, NodeTable& nodes) {
+    if (isPuzzleComplete(puzzle)) return true;
+    std::unique_ptr<Trail<G>> trail(new Trail<G>());
+    tasks = {puzzle};
+    while (tasks.size() < target) {
+        vector<Puzzle<G>> children;
+        for (const Puzzle<G>& task : tasks) {
+            Pair chosenTileCoords;
+            if (!selectUnassignedVariable(task, chosenTileCoords)) continue;
+            auto chosenTile = tileBit<G>(chosenTileCoords.row, chosenTileCoords.col);
+            for (int value : {0, 1}) {
+                if (value == 0 && !(task.canBeEmpty & chosenTile)) continue;
+                if (value == 1 && !(task.canBeBomb & chosenTile)) continue;
+                Puzzle<G> child = task;
+                trail->size = 0;
+                assignTile(chosenTileCoords.row, chosenTileCoords.col, value ? BOMB : EMPTY, child, *trail);
+                nodes.insert(child.hash);
+                if (!forwardChecking(chosenTileCoords.row, chosenTileCoords.col, child, *trail)) continue;
+                if (isPuzzleComplete(child)) {
+                    puzzle = child;
+                    return true;
+                }
+                children.push_back(std::move(child));
             }
         }
+        // no children left means every branch failed
+        tasks = std::move(children);
+        if (tasks.empty()) return false;
     }
+    return false;
+}
 
-    // unassigned variables related to adjacent number tiles
-    NumberedTileHelper helper;
-    for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
-        for (int colOffset = -1; colOffset < 2; ++colOffset) {
-            if (rowOffset == 0 && colOffset == 0) continue;
-            if (!isInGrid(row + rowOffset, col + colOffset)) {
+template <typename G, typename Deliver>
+void lockstepBatch(const PuzzleSet& puzzles, const Options& options, std::atomic<size_t>& next,
+                   Deliver deliver) {
+    using Bits = typename G::Bits;
+    constexpr int WORDS = G::Bits::WORDS;
+    std::unique_ptr<LaneBoard<G>> board(new LaneBoard<G>());
+    vector<LaneSearch<G>> lanes(LANES, LaneSearch<G>(options.counting));
+    PuzzleInput input;
+    int bombsPerUnit = options.bombsPerUnit > 0 ? options.bombsPerUnit : G::DEFAULT_BOMBS_PER_UNIT;
+    // the answer for the board of a lane, built the way solvePuzzle builds it
+    auto answer = [&](const Bits& bombs, const LaneSearch<G>& search, bool solved) {
+        Puzzle<G> puzzle;
+        puzzle.bombs = bombs;
+        puzzle.numbered = laneBits<G>(board->numbered, &search - lanes.data());
+        size_t nodes = search.nodes.size();
+        int status = solved ? SOLVER_SOLVED : SOLVER_UNSOLVABLE;
+        if (options.format == BINARY_OUTPUT) return packAnswer(puzzle, nodes, status);
+        return formatAnswer(puzzle, nodes, status);
+    };
+    // puts the next puzzle the lanes can take in a lane, solving the others on the way
+    auto refill = [&](int lane) {
+        LaneSearch<G>& search = lanes[lane];
+        for (size_t index = next++; index < puzzles.size(); index = next++) {
+            puzzles.decode(index, input);
+            if (input.gridSize == G::GRID_SIZE &&
+                loadLane(makePuzzle<G>(input.values.data(), options.bombsPerUnit), lane, *board)) {
+                search.index = index;
+                search.hash = 0;
+                search.depth = 0;
+                search.nodes.clear();
+                return;
+            }
+            deliver(index, solve(input, options).answer);
+        }
+        search.index = SIZE_MAX;
+    };
+    for (int lane = 0; lane < LANES; ++lane) refill(lane);
+    int tiles[LANES];
+    auto busy = [](const LaneSearch<G>& search) { return search.index != SIZE_MAX; };
+    while (std::any_of(lanes.begin(), lanes.end(), busy)) {
+        // the assignments made by propagation get hashed afterwards, as assignTile would have hashed them
+        LaneWord bombsBefore[WORDS], emptiesBefore[WORDS];
+        std::copy(board->bombs, board->bombs + WORDS, bombsBefore);
+        std::copy(board->empties, board->empties + WORDS, emptiesBefore);
+        LaneWord failed;
+        propagateLanes(*board, bombsPerUnit, failed);
+        selectLaneTiles(*board, tiles);
+        for (int lane = 0; lane < LANES; ++lane) {
+            LaneSearch<G>& search = lanes[lane];
+            if (search.index == SIZE_MAX) continue;
+            if (failed[lane]) {
+                // a lane that fails before its first decision fails its initial inference
+                if (search.depth == 0) {
+                    puzzles.decode(search.index, input);
+                    deliver(search.index, solve(input, options).answer);
+                    refill(lane);
+                } else if (!backtrackLane(*board, lane, search)) {
+                    // every decision is undone, which leaves the board the first decision was made on
+                    deliver(search.index, answer(search.frames[0].bombs, search, false));
+                    refill(lane);
+                }
                 continue;
             }
-
-            // get adjacent tiles and see if they are numbered
-            Tile* tile = puzzle[row + rowOffset][col + colOffset];
-            if (tile->num == 0) continue;
-
-            // get the tiles adjacent to the numbered tile and see if they are unassigned
-            for (int numRowOffset = -1; numRowOffset < 2; ++numRowOffset) {
-                for (int numColOffset = -1; numColOffset < 2; ++numColOffset) {
-                    // don't add dupes
-                    if (numRowOffset == 0 && numColOffset == 0) continue;
-                    int currRow = row + rowOffset + numRowOffset;
-                    int currCol = col + colOffset + numColOffset;
-                    if (!isInGrid(currRow, currCol)) continue;
-                    if (currRow == row && currCol == col) continue;
-                    if (isInRow(row, col, currRow, currCol)) continue;
-                    if (isInCol(row, col, currRow, currCol)) continue;
-                    if (isInBox(row, col, currRow, currCol)) continue;
-
-                    Tile* tile = puzzle[row + numRowOffset][col + numColOffset];
-                    if (tile->assignment == UNASSIGNED && tile->num == 0) {
-                        helper.addTile(currRow, currCol);
+            if (options.counting == DISTINCT_NODES) {
+                for (int word = 0; word < WORDS; ++word) {
+                    for (uint64_t bits = board->bombs[word][lane] & ~bombsBefore[word][lane]; bits; bits &= bits - 1) {
+                        search.hash ^= ZOBRIST<G>.keys[64 * word + __builtin_ctzll(bits)][BOMBS];
+                    }
+                    for (uint64_t bits = board->empties[word][lane] & ~emptiesBefore[word][lane]; bits;
+                         bits &= bits - 1) {
+                        search.hash ^= ZOBRIST<G>.keys[64 * word + __builtin_ctzll(bits)][EMPTIES];
                     }
                 }
             }
+            if (tiles[lane] < 0) {
+                deliver(search.index, answer(laneBits<G>(board->bombs, lane), search, true));
+                refill(lane);
+                continue;
+            }
+            // decide EMPTY on the chosen tile, keeping the board to come back to for BOMB
+            int tile = tiles[lane];
+            LaneFrame<G>& frame = search.frames[search.depth++];
+            frame.bombs = laneBits<G>(board->bombs, lane);
+            frame.empties = laneBits<G>(board->empties, lane);
+            frame.canBeBomb = laneBits<G>(board->canBeBomb, lane);
+            frame.canBeEmpty = laneBits<G>(board->canBeEmpty, lane);
+            frame.hash = search.hash;
+            frame.tile = tile;
+            frame.triedBomb = false;
+            board->empties[tile / 64][lane] |= uint64_t(1) << (tile % 64);
+            search.hash ^= ZOBRIST<G>.keys[tile][EMPTIES];
+            search.nodes.insert(search.hash);
+            STATS_COUNT(decisions);
+        }
+    }
+}
+
+template <typename G>
+bool loadLane(const Puzzle<G>& puzzle, int lane, LaneBoard<G>& board) {
+    typename G::Bits nums[4], emptyCaps[4];
+    auto numbered = puzzle.numbered;
+    while (numbered) {
+        int tile = popLowestTile(numbered);
+        int emptyCap = popcount(MASKS<G>.neighbours[tile] & ~puzzle.numbered) - puzzle.nums[tile];
+        if (emptyCap < 0) return false;
+        for (int slice = 0; slice < 4; ++slice) {
+            if ((puzzle.nums[tile] >> slice) & 1) nums[slice] |= G::Bits::bit(tile);
+            if ((emptyCap >> slice) & 1) emptyCaps[slice] |= G::Bits::bit(tile);
         }
     }
-    unassignedVariables += helper.getUnassignedTiles();
+    setLaneBits<G>(board.bombs, lane, puzzle.bombs);
+    setLaneBits<G>(board.empties, lane, puzzle.empties);
+    setLaneBits<G>(board.canBeBomb, lane, puzzle.canBeBomb);
+    setLaneBits<G>(board.canBeEmpty, lane, puzzle.canBeEmpty);
+    setLaneBits<G>(board.numbered, lane, puzzle.numbered);
+    for (int slice = 0; slice < 4; ++slice) {
+        setLaneBits<G>(board.nums[slice], lane, nums[slice]);
+        setLaneBits<G>(board.emptyCaps[slice], lane, emptyCaps[slice]);
+    }
+    return true;
+}
 
-    return unassignedVariables;
+template <typename G>
+void propagateLanes(LaneBoard<G>& board, int bombsPerUnit, LaneWord& failed) {
+    constexpr int WORDS = G::Bits::WORDS;
+    const Masks<G>& masks = MASKS<G>;
+    const auto& allTiles = G::ALL_TILES.words;
+    int emptysPerUnit = G::GRID_SIZE - bombsPerUnit;
+    failed = LaneWord{};
+    while (true) {
+        // the unassigned tiles that lose a value, gathered from every rule before any of them is applied
+        LaneWord noBomb[WORDS] = {}, noEmpty[WORDS] = {};
+        for (int unit = 0; unit < G::UNITS; ++unit) {
+            const auto& members = masks.units[unit].words;
+            LaneWord bombs, empties;
+            lanePopcount<G>(board.bombs, masks.units[unit], bombs);
+            lanePopcount<G>(board.empties, masks.units[unit], empties);
+            failed |= (LaneWord)((bombs > uint64_t(bombsPerUnit)) | (empties > uint64_t(emptysPerUnit)));
+            LaneWord allBombs = (LaneWord)(bombs == uint64_t(bombsPerUnit));
+            LaneWord allEmpties = (LaneWord)(empties == uint64_t(emptysPerUnit));
+            for (int word = 0; word < WORDS; ++word) {
+                if (!members[word]) continue;
+                noBomb[word] |= members[word] & allBombs;
+                noEmpty[word] |= members[word] & allEmpties;
+            }
+        }
+        // numbered tiles, with all their neighbours counted at once
+        LaneWord blankEmpties[WORDS];
+        for (int word = 0; word < WORDS; ++word) blankEmpties[word] = board.empties[word] & ~board.numbered[word];
+        LaneWord bombCounts[4][WORDS], emptyCounts[4][WORDS];
+        neighbourCounts<G>(board.bombs, bombCounts);
+        neighbourCounts<G>(blankEmpties, emptyCounts);
+        LaneWord allBombs[WORDS], allEmpties[WORDS], over[WORDS];
+        for (int word = 0; word < WORDS; ++word) {
+            // compare the counts with the limits from the highest slice down
+            LaneWord bombsEqual = ~LaneWord{}, emptiesEqual = ~LaneWord{}, bombsOver = {}, emptiesOver = {};
+            for (int slice = 3; slice >= 0; --slice) {
+                bombsOver |= bombsEqual & bombCounts[slice][word] & ~board.nums[slice][word];
+                bombsEqual &= ~(bombCounts[slice][word] ^ board.nums[slice][word]);
+                emptiesOver |= emptiesEqual & emptyCounts[slice][word] & ~board.emptyCaps[slice][word];
+                emptiesEqual &= ~(emptyCounts[slice][word] ^ board.emptyCaps[slice][word]);
+            }
+            allBombs[word] = board.numbered[word] & bombsEqual;
+            allEmpties[word] = board.numbered[word] & emptiesEqual;
+            over[word] = board.numbered[word] & (bombsOver | emptiesOver);
+        }
+        laneAny<G>(over, failed);
+        forEachNeighbourShift<G>(allBombs, [&](const LaneWord* tiles) {
+            for (int word = 0; word < WORDS; ++word) noBomb[word] |= tiles[word];
+        });
+        forEachNeighbourShift<G>(allEmpties, [&](const LaneWord* tiles) {
+            for (int word = 0; word < WORDS; ++word) noEmpty[word] |= tiles[word];
+        });
+        // a tile left with no value fails its lane, one left with a single value is forced
+        LaneWord dead[WORDS], forcedAny = {};
+        for (int word = 0; word < WORDS; ++word) {
+            LaneWord unassigned = allTiles[word] & ~(board.bombs[word] | board.empties[word]);
+            board.canBeBomb[word] &= ~(noBomb[word] & unassigned);
+            board.canBeEmpty[word] &= ~(noEmpty[word] & unassigned);
+            dead[word] = unassigned & ~(board.canBeBomb[word] | board.canBeEmpty[word]);
+            // a failed lane is left as it is
+            LaneWord forced = unassigned & (board.canBeBomb[word] ^ board.canBeEmpty[word]) & ~failed;
+            board.bombs[word] |= forced & board.canBeBomb[word];
+            board.empties[word] |= forced & board.canBeEmpty[word];
+            forcedAny |= forced;
+        }
+        laneAny<G>(dead, failed);
+        LaneWord progress = forcedAny & ~failed;
+        bool any = false;
+        for (int lane = 0; lane < LANES; ++lane) any |= progress[lane] != 0;
+        if (!any) return;
+    }
 }
 
-int mrv(Tile& tile) {
-    int possibilities = 0;
-    if (tile.domain.canBeBomb == true) {
-        ++possibilities;
+template <typename G>
+void selectLaneTiles(const LaneBoard<G>& board, int tiles[LANES]) {
+    STATS_TIME(select);
+    constexpr int WORDS = G::Bits::WORDS;
+    const Masks<G>& masks = MASKS<G>;
+    LaneWord unassigned[WORDS];
+    for (int word = 0; word < WORDS; ++word) {
+        unassigned[word] = G::ALL_TILES.words[word] & ~(board.bombs[word] | board.empties[word]);
+    }
+    // a tile's degree counts the units and numbered neighbours that still have another unassigned tile
+    LaneWord degrees[4][WORDS] = {};
+    for (int unit = 0; unit < G::UNITS; ++unit) {
+        LaneWord open;
+        lanePopcount<G>(unassigned, masks.units[unit], open);
+        open = (LaneWord)(open > 1);
+        LaneWord members[WORDS];
+        for (int word = 0; word < WORDS; ++word) members[word] = masks.units[unit].words[word] & open;
+        addToCounts<G, 2>(degrees, members);
+    }
+    LaneWord openCounts[4][WORDS], openClues[WORDS];
+    neighbourCounts<G>(unassigned, openCounts);
+    for (int word = 0; word < WORDS; ++word) {
+        openClues[word] = board.numbered[word] & (openCounts[1][word] | openCounts[2][word] | openCounts[3][word]);
+    }
+    forEachNeighbourShift<G>(openClues, [&](const LaneWord* tiles) { addToCounts<G, 4>(degrees, tiles); });
+    // keep the tiles of the highest degree, slice by slice from the top
+    LaneWord best[WORDS];
+    std::copy(unassigned, unassigned + WORDS, best);
+    for (int slice = 3; slice >= 0; --slice) {
+        LaneWord higher[WORDS];
+        for (int word = 0; word < WORDS; ++word) higher[word] = best[word] & degrees[slice][word];
+        LaneWord found = {};
+        laneAny<G>(higher, found);
+        for (int word = 0; word < WORDS; ++word) best[word] = (higher[word] & found) | (best[word] & ~found);
+    }
+    for (int lane = 0; lane < LANES; ++lane) {
+        auto bits = laneBits<G>(best, lane);
+        tiles[lane] = bits ? lowestTile(bits) : -1;
     }
-    if (tile.domain.canBeEmpty == true) {
-        ++possibilities;
+}
+
+template <typename G>
+bool backtrackLane(LaneBoard<G>& board, int lane, LaneSearch<G>& search) {
+    while (search.depth > 0) {
+        LaneFrame<G>& frame = search.frames[search.depth - 1];
+        if (frame.triedBomb) {
+            --search.depth;
+            continue;
+        }
+        frame.triedBomb = true;
+        auto bit = G::Bits::bit(frame.tile);
+        setLaneBits<G>(board.bombs, lane, frame.bombs | bit);
+        setLaneBits<G>(board.empties, lane, frame.empties);
+        setLaneBits<G>(board.canBeBomb, lane, frame.canBeBomb);
+        setLaneBits<G>(board.canBeEmpty, lane, frame.canBeEmpty & ~bit);
+        search.hash = frame.hash ^ ZOBRIST<G>.keys[frame.tile][BOMBS];
+        search.nodes.insert(search.hash);
+        STATS_COUNT(decisions);
+        return true;
     }
-    return possibilities;
+    return false;
 }
 
-int getBoxFromCoords(int row, int col) {
-    return row / 3 + (col / 3) * 3;
+template <typename G>
+typename G::Bits laneBits(const LaneWord* words, int lane) {
+    typename G::Bits bits;
+    for (int word = 0; word < G::Bits::WORDS; ++word) bits.words[word] = words[word][lane];
+    return bits;
 }
 
-Pair getStartCoordsFromBox(int box) {
-    return {.row = (box / 3) * 3, .col = (box % 3) * 3};
+template <typename G>
+void setLaneBits(LaneWord* words, int lane, const typename G::Bits& bits) {
+    for (int word = 0; word < G::Bits::WORDS; ++word) words[word][lane] = bits.words[word];
 }
 
-bool isNumberedTileConsistent(int row, int col, vector<vector<Tile*>>& puzzle) {
-    Tile* currTile = puzzle[row][col];
-    int adjBombs = currTile->num;
-    int adjEmptys = 8 - adjBombs;
-    for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
-        for (int colOffset = -1; colOffset < 2; ++colOffset) {
-            if (rowOffset == 0 && colOffset == 0) continue;
-            if (!isInGrid(row + rowOffset, col + colOffset)) {
-                --adjEmptys;
-                continue;
-            }
+template <typename G>
+void lanePopcount(const LaneWord* bits, const typename G::Bits& mask, LaneWord& count) {
+    // byte counts of every word, summed before they are folded into one count per lane
+    LaneWord bytes = {};
+    for (int word = 0; word < G::Bits::WORDS; ++word) {
+        if (!mask.words[word]) continue;
+        LaneWord x = bits[word] & mask.words[word];
+        x = x - ((x >> 1) & 0x5555555555555555);
+        x = (x & 0x3333333333333333) + ((x >> 2) & 0x3333333333333333);
+        bytes += (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0f;
+    }
+    bytes += bytes >> 8;
+    bytes += bytes >> 16;
+    bytes += bytes >> 32;
+    count = bytes & 0xff;
+}
+
+template <typename G>
+void laneAny(const LaneWord* bits, LaneWord& any) {
+    LaneWord set = {};
+    for (int word = 0; word < G::Bits::WORDS; ++word) set |= bits[word];
+    any |= (LaneWord)(set != 0);
+}
+
+template <typename G, int Slices>
+void addToCounts(LaneWord counts[][G::Bits::WORDS], const LaneWord* bits) {
+    for (int word = 0; word < G::Bits::WORDS; ++word) {
+        LaneWord carry = bits[word];
+        for (int slice = 0; slice < Slices; ++slice) {
+            LaneWord next = counts[slice][word] & carry;
+            counts[slice][word] ^= carry;
+            carry = next;
+        }
+    }
+}
 
-            Tile* tile = puzzle[row + rowOffset][col + colOffset];
-            if (tile->num == 0 && tile->assignment == BOMB) {
-                --adjBombs;
-            } else if (tile->num == 0 && tile->assignment == EMPTY) {
-                --adjEmptys;
+template <typename G, typename Visit>
+void forEachNeighbourShift(const LaneWord* bits, Visit visit) {
+    constexpr int WORDS = G::Bits::WORDS;
+    // the tiles of the first and the last column, which must not wrap around to the next row
+    constexpr auto edges = [] {
+        std::array<typename G::Bits, 2> result{};
+        for (int row = 0; row < G::GRID_SIZE; ++row) {
+            result[0] |= G::Bits::bit(row * G::GRID_SIZE);
+            result[1] |= G::Bits::bit(row * G::GRID_SIZE + G::GRID_SIZE - 1);
+        }
+        return result;
+    }();
+    for (int colStep = -1; colStep <= 1; ++colStep) {
+        LaneWord source[WORDS];
+        for (int word = 0; word < WORDS; ++word) {
+            source[word] = colStep == 0 ? bits[word] : bits[word] & ~edges[colStep > 0].words[word];
+        }
+        for (int rowStep = -1; rowStep <= 1; ++rowStep) {
+            if (rowStep == 0 && colStep == 0) continue;
+            // tile t moves to t + offset in row-major order, tiles that fall off the board are dropped
+            int offset = rowStep * G::GRID_SIZE + colStep;
+            LaneWord shifted[WORDS];
+            if (offset > 0) {
+                for (int word = WORDS - 1; word >= 0; --word) {
+                    shifted[word] = source[word] << offset;
+                    if (word > 0) shifted[word] |= source[word - 1] >> (64 - offset);
+                }
+            } else {
+                for (int word = 0; word < WORDS; ++word) {
+                    shifted[word] = source[word] >> -offset;
+                    if (word + 1 < WORDS) shifted[word] |= source[word + 1] << (64 + offset);
+                }
             }
+            shifted[WORDS - 1] &= G::ALL_TILES.words[WORDS - 1];
+            visit(shifted);
         }
     }
-    return adjBombs < 0 || adjEmptys < 0;
 }
 
-bool isInRow(int row, int col, int newRow, int newCol) {
-    return row == newRow;
+template <typename G>
+void neighbourCounts(const LaneWord* bits, LaneWord counts[4][G::Bits::WORDS]) {
+    for (int slice = 0; slice < 4; ++slice) {
+        for (int word = 0; word < G::Bits::WORDS; ++word) counts[slice][word] = LaneWord{};
+    }
+    forEachNeighbourShift<G>(bits, [&](const LaneWord* tiles) { addToCounts<G, 4>(counts, tiles); });
 }
+#endif
 
-bool isInCol(int row, int col, int newRow, int newCol) {
-    return col == newCol;
+template <int Words>
+int popcount(const Bitboard<Words>& board) {
+    int count = 0;
+    for (int word = 0; word < Words; ++word) count += __builtin_popcountll(board.words[word]);
+    return count;
 }
 
-bool isInBox(int row, int col, int newRow, int newCol) {
-    int box = getBoxFromCoords(row, col);
-    Pair startCoords = getStartCoordsFromBox(box);
-    for (size_t startRow = startCoords.row; startRow < startCoords.row + 3; ++startRow) {
-        for (size_t startCol = startCoords.col; startCol < startCoords.col + 3; ++startCol) {
-            if (startRow == newRow && startCol == newCol) {
-                return true;
-            }
+template <int Words>
+int lowestTile(const Bitboard<Words>& board) {
+    for (int word = 0; word < Words - 1; ++word) {
+        if (board.words[word]) return 64 * word + __builtin_ctzll(board.words[word]);
+    }
+    return 64 * (Words - 1) + __builtin_ctzll(board.words[Words - 1]);
+}
+
+template <int Words>
+int popLowestTile(Bitboard<Words>& board) {
+    for (int word = 0; word < Words; ++word) {
+        if (board.words[word]) {
+            int tile = 64 * word + __builtin_ctzll(board.words[word]);
+            board.words[word] &= board.words[word] - 1;
+            return tile;
         }
     }
-    return false;
+    return -1;
+}
+
+template <typename G>
+typename G::Bits unassignedTiles(const Puzzle<G>& puzzle) {
+    return G::ALL_TILES & ~(puzzle.bombs | puzzle.empties);
+}
+
+template <typename G>
+typename G::Bits& trailedField(Puzzle<G>& puzzle, TrailField field) {
+    switch (field) {
+    case BOMBS:
+        return puzzle.bombs;
+    case EMPTIES:
+        return puzzle.empties;
+    case CAN_BE_BOMB:
+        return puzzle.canBeBomb;
+    default:
+        return puzzle.canBeEmpty;
+    }
+}
+
+template <typename G>
+void initConstraintCounts(Puzzle<G>& puzzle) {
+    const Masks<G>& masks = MASKS<G>;
+    auto unassigned = unassignedTiles(puzzle);
+    for (int unit = 0; unit < G::UNITS; ++unit) {
+        puzzle.units[unit].bombs = popcount(masks.units[unit] & puzzle.bombs);
+        puzzle.units[unit].empties = popcount(masks.units[unit] & puzzle.empties);
+        puzzle.units[unit].unassigned = popcount(masks.units[unit] & unassigned);
+    }
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        auto blankNeighbours = masks.neighbours[tile] & ~puzzle.numbered;
+        puzzle.clues[tile].bombs = popcount(blankNeighbours & puzzle.bombs);
+        puzzle.clues[tile].empties = popcount(blankNeighbours & puzzle.empties);
+        puzzle.clues[tile].unassigned = popcount(blankNeighbours & unassigned);
+    }
+    for (int tile = 0; tile < G::CELLS; ++tile) {
+        if (puzzle.nums[tile] != 0) continue;
+        puzzle.degrees[tile] = degreeHeuristic(tile / G::GRID_SIZE, tile % G::GRID_SIZE, puzzle);
+        puzzle.degreeBuckets[puzzle.degrees[tile]] |= G::Bits::bit(tile);
+    }
+}
+
+template <typename G>
+void updateConstraintCounts(int tile, TrailField assignment, int delta, Puzzle<G>& puzzle) {
+    const Masks<G>& masks = MASKS<G>;
+    for (int unit : masks.tileUnits[tile]) {
+        updateConstraint(masks.units[unit], puzzle.units[unit], tile, assignment, delta, puzzle);
+    }
+    auto numberedNeighbours = masks.neighbours[tile] & puzzle.numbered;
+    while (numberedNeighbours) {
+        int clue = popLowestTile(numberedNeighbours);
+        updateConstraint(masks.neighbours[clue], puzzle.clues[clue], tile, assignment, delta, puzzle);
+    }
+}
+
+template <typename G>
+void updateConstraint(const typename G::Bits& members, ConstraintCounts& counts, int tile, TrailField assignment,
+                      int delta, Puzzle<G>& puzzle) {
+    (assignment == BOMBS ? counts.bombs : counts.empties) += delta;
+    counts.unassigned -= delta;
+    // assigning takes the constraint from 2 unassigned tiles to 1, unassigning from 1 back to 2
+    if (counts.unassigned == (delta > 0 ? 1 : 2)) {
+        int other = lowestTile(members & unassignedTiles(puzzle) & ~G::Bits::bit(tile));
+        setDegree(other, puzzle.degrees[other] - delta, puzzle);
+    }
+}
+
+template <typename G>
+void setDegree(int tile, int degree, Puzzle<G>& puzzle) {
+    auto bit = G::Bits::bit(tile);
+    puzzle.degreeBuckets[puzzle.degrees[tile]] &= ~bit;
+    puzzle.degreeBuckets[degree] |= bit;
+    puzzle.degrees[tile] = degree;
+}
+
+template <typename G>
+void assignTile(int row, int col, Assignment assignment, Puzzle<G>& puzzle, Trail<G>& trail) {
+    STATS_TIME(assign);
+    int tile = row * G::GRID_SIZE + col;
+    TrailField field = assignment == BOMB ? BOMBS : EMPTIES;
+    uint64_t bit = uint64_t(1) << (tile % 64);
+    trail.entries[trail.size++] = {bit, uint16_t(tile / 64), uint8_t(field)};
+    trailedField(puzzle, field).words[tile / 64] |= bit;
+    puzzle.hash ^= ZOBRIST<G>.keys[tile][field];
+    updateConstraintCounts(tile, field, 1, puzzle);
 }
 
-bool backtrackingSearch(vector<vector<Tile*>>& puzzle, unordered_set<string>& nodes) {
-    // if assignment is complete return true
+template <typename G>
+void removeFromDomain(const typename G::Bits& tiles, TrailField domain, Puzzle<G>& puzzle, Trail<G>& trail) {
+    auto& field = trailedField(puzzle, domain);
+    for (int word = 0; word < G::Bits::WORDS; ++word) {
+        // only record the bits that actually change
+        uint64_t changed = tiles.words[word] & field.words[word];
+        if (!changed) continue;
+        trail.entries[trail.size++] = {changed, uint16_t(word), uint8_t(domain)};
+        field.words[word] &= ~changed;
+    }
+}
+
+template <typename G>
+void undoTo(int mark, Puzzle<G>& puzzle, Trail<G>& trail) {
+    STATS_TIME(undo);
+    while (trail.size > mark) {
+        const TrailEntry& entry = trail.entries[--trail.size];
+        TrailField field = TrailField(entry.field);
+        // entries hold exactly the bits that flipped, so flipping them again restores the field
+        trailedField(puzzle, field).words[entry.word] ^= entry.bits;
+        // assignment entries always hold a single tile
+        if (field == BOMBS || field == EMPTIES) {
+            int tile = 64 * entry.word + __builtin_ctzll(entry.bits);
+            puzzle.hash ^= ZOBRIST<G>.keys[tile][field];
+            updateConstraintCounts(tile, field, -1, puzzle);
+        }
+    }
+}
+
+template <typename G>
+int degreeHeuristic(int row, int col, const Puzzle<G>& puzzle) {
+    const Masks<G>& masks = MASKS<G>;
+    int tile = row * G::GRID_SIZE + col;
+    int degree = 0;
+    for (int unit : masks.tileUnits[tile]) {
+        degree += puzzle.units[unit].unassigned > 1;
+    }
+    for (int i = 0; i < masks.neighbourCount[tile]; ++i) {
+        int neighbour = masks.neighbourList[tile][i];
+        if (puzzle.nums[neighbour] != 0) degree += puzzle.clues[neighbour].unassigned > 1;
+    }
+    return degree;
+}
+
+template <typename G>
+bool backtrackingSearch(Puzzle<G>& puzzle, Trail<G>& trail, NodeTable& nodes, SearchControl* control,
+                        SolutionCount<G>* solutions) {
+    // if assignment is complete return true, or count it and keep going until the cap
 
     if (isPuzzleComplete(puzzle)) {
-        // Testing
-        string currStatus = puzzleStatus(puzzle);
-        const char* currentStatus = currStatus.c_str();
-        cout << endl << currStatus << endl;
-        return true;
+        if (!solutions) return true;
+        if (solutions->count++ == 0) solutions->first = puzzle;
+        return solutions->count >= solutions->cap;
     }
+    // a count stops the same way it does at the cap
+    if (control && control->expired(nodes.size())) return solutions != nullptr;
+    STATS_DEPTH();
 
-    Tile* chosenTile = selectUnassignedVariable(puzzle);
-    if (!chosenTile) return false;
-    Pair chosenTileCoords = getCoordsOfTile(chosenTile, puzzle);
-    // cout << "Row:	Col:" << endl;
-    // cout << chosenTileCoords.row << "	" << chosenTileCoords.col << endl;
-    vector<int> domain{0, 1};
-    for (int value : domain) {
+    Pair chosenTileCoords;
+    if (!selectUnassignedVariable(puzzle, chosenTileCoords, control ? &control->random : nullptr)) return false;
+    auto chosenTile = tileBit<G>(chosenTileCoords.row, chosenTileCoords.col);
+    int firstValue = control && control->bombFirst;
+    if (control && control->phases) firstValue = control->phases[lowestTile(chosenTile)];
+    for (int value : {firstValue, 1 - firstValue}) {
         // If value is consistent with assignment
-        if (value == 0 && !chosenTile->domain.canBeEmpty) continue;
-        if (value == 1 && !chosenTile->domain.canBeBomb) continue;
+        if (value == 0 && !(puzzle.canBeEmpty & chosenTile)) continue;
+        if (value == 1 && !(puzzle.canBeBomb & chosenTile)) continue;
+        // Everything done for this value gets undone by popping the trail back to here
+        int mark = trail.size;
         // Add var = value to assignment
-        value ? chosenTile->assignment = BOMB : chosenTile->assignment = EMPTY;
-        nodes.insert(makeKey(puzzle));
-        // string currStatus = puzzleStatus(puzzle);
-        // const char* currentStatus = currStatus.c_str();
-        vector<vector<Tile>> copy = makeCopy(puzzle);
-        bool inference = forwardChecking(chosenTileCoords.row, chosenTileCoords.col, puzzle);
+        assignTile(chosenTileCoords.row, chosenTileCoords.col, value ? BOMB : EMPTY, puzzle, trail);
+        STATS_COUNT(decisions);
+        if (control) ++control->decisions;
+        nodes.insert(puzzle.hash);
+        bool inference = forwardChecking(chosenTileCoords.row, chosenTileCoords.col, puzzle, trail);
+        // the costlier rules only pay for themselves close to the root
+        if (inference && control && control->depth + 1 < control->subsetDepth) {
+            inference = subsetInference(puzzle, trail);
+        }
+        // a state already refuted through another order of decisions fails straight away. A count goes on past
+        // solutions, so its failures prove nothing.
+        RefutationTable* refuted = control && !solutions ? control->refuted : nullptr;
+        ZobristKey state = 0;
+        if (inference && refuted) {
+            state = stateKey(puzzle);
+            inference = !refuted->contains(state);
+            STATS_COUNT(refutationProbes);
+            if (!inference) STATS_COUNT(refutationHits);
+        }
         // inference != failure
         if (inference) {
-            bool resultPassed = backtrackingSearch(puzzle, nodes);
+            size_t nodesBefore = nodes.size();
+            if (control) ++control->depth;
+            bool resultPassed = backtrackingSearch(puzzle, trail, nodes, control, solutions);
+            if (control) --control->depth;
             if (resultPassed) return resultPassed;
-            // Remove inferences from csp
-            copyPuzzle(puzzle, copy);
+            if (control && (control->gaveUp || control->restart)) return false;
+            if (refuted) refuted->insert(state, nodes.size() - nodesBefore);
         }
-        value ? chosenTile->domain.canBeBomb = false : chosenTile->domain.canBeEmpty = false;
+        // Remove var = value and its inferences from csp
+        STATS_COUNT(backtracks);
+        undoTo(mark, puzzle, trail);
+        removeFromDomain(chosenTile, value ? CAN_BE_BOMB : CAN_BE_EMPTY, puzzle, trail);
     }
     return false;
 }
 
-Tile* selectUnassignedVariable(vector<vector<Tile*>>& puzzle) {
-    // mrv: lower = better
-    int bestMrv = 2;
-    // dh: higher = better
-    int bestDH = 0;
-    Tile* nextTile = nullptr;
-    // one pass search for the best tile to assign next
-    for (size_t row = 0; row < puzzle.size(); ++row) {
-        for (size_t col = 0; col < puzzle[row].size(); ++col) {
-            Tile* tile = puzzle[row][col];
-            if (tile->num != 0 || tile->assignment != UNASSIGNED) continue;
-            int mrvVal = mrv(*tile);
-            if (mrvVal > bestMrv) {
-                continue;
-            }
-            int dhVal = degreeHeuristic(row, col, puzzle);
-            if (mrvVal < bestMrv || dhVal > bestDH) {
-                bestMrv = mrvVal;
-                bestDH = dhVal;
-                nextTile = tile;
-            }
-        }
+#ifndef SOLVER_LIBRARY
+template <typename G>
+bool restartingSearch(Puzzle<G>& puzzle, Trail<G>& trail, NodeTable& nodes, SearchControl& control, size_t unit) {
+    int root = trail.size;
+    for (uint64_t run = 1;; ++run) {
+        control.decisions = 0;
+        control.restart = false;
+        control.restartLimit = luby(run) * unit;
+        if (backtrackingSearch(puzzle, trail, nodes, &control)) return true;
+        // a run that neither restarted nor gave up has searched everything
+        if (!control.restart) return false;
+        undoTo(root, puzzle, trail);
     }
-    return nextTile;
 }
+#endif
 
-bool isPuzzleComplete(vector<vector<Tile*>>& puzzle) {
-    bool hasUnassigned = false;
-    for (vector<Tile*>& row : puzzle) {
-        for (Tile* tile : row) {
-            if (tile->assignment == UNASSIGNED && tile->num == 0) {
-                hasUnassigned = true;
-            }
-        }
+uint64_t luby(uint64_t index) {
+    // the sequence is made of blocks that end at 2^k - 1 with the value 2^(k - 1), each a copy of all before it
+    while (true) {
+        int k = 1;
+        while ((uint64_t(1) << k) - 1 < index) ++k;
+        if (index == (uint64_t(1) << k) - 1) return uint64_t(1) << (k - 1);
+        index -= (uint64_t(1) << (k - 1)) - 1;
     }
-    return !hasUnassigned;
 }
 
-bool forwardCheckRow(int row, int col, vector<vector<Tile*>>& puzzle) {
-    int numBombs = 0;
-    int numEmptys = 0;
-    for (size_t c = 0; c < puzzle[row].size(); ++c) {
-        numBombs += (puzzle[row][c]->assignment == BOMB);
-        numEmptys += (puzzle[row][c]->assignment == EMPTY);
-    }
-    // Check if we are third bomb. If we are, remove canBeBomb from every other unassigned tile's domain
-    if (puzzle[row][col]->assignment == BOMB && numBombs == 3) {
-        for (size_t c = 0; c < puzzle[row].size(); ++c) {
-            if (c == col || puzzle[row][c]->num != 0 || puzzle[row][c]->assignment != UNASSIGNED) continue;
-            puzzle[row][c]->domain.canBeBomb = false;
-            if (!puzzle[row][c]->domain.canBeBomb && !puzzle[row][c]->domain.canBeEmpty) {
-                return false;
-            }
-        }
-    }
-    // We are the final empty possible
-    if (puzzle[row][col]->assignment == EMPTY && numEmptys == 6) {
-        for (size_t c = 0; c < puzzle[row].size(); ++c) {
-            if (c == col || puzzle[row][c]->num != 0 || puzzle[row][c]->assignment != UNASSIGNED) continue;
-            puzzle[row][c]->domain.canBeEmpty = false;
-            if (!puzzle[row][c]->domain.canBeBomb && !puzzle[row][c]->domain.canBeEmpty) {
-                return false;
+template <typename G>
+bool selectUnassignedVariable(const Puzzle<G>& puzzle, Pair& chosenTile, uint64_t* random) {
+    STATS_TIME(select);
+    using Bits = typename G::Bits;
+    Bits unassigned = unassignedTiles(puzzle);
+    // mrv: lower = better. A tile with no values left goes first so that the search fails on it right away.
+    Bits byMrv[3] = {
+        unassigned & ~(puzzle.canBeBomb | puzzle.canBeEmpty),
+        unassigned & (puzzle.canBeBomb ^ puzzle.canBeEmpty),
+        unassigned & puzzle.canBeBomb & puzzle.canBeEmpty,
+    };
+    for (const Bits& candidates : byMrv) {
+        if (!candidates) continue;
+        // dh: higher = better, ties go to the first tile in row-major order
+        for (int degree = MAX_DEGREE; degree >= 0; --degree) {
+            Bits best = candidates & puzzle.degreeBuckets[degree];
+            if (!best) continue;
+            if (random && *random) {
+                for (int skip = nextRandom(*random) % popcount(best); skip > 0; --skip) popLowestTile(best);
             }
+            int tile = lowestTile(best);
+            chosenTile = {tile / G::GRID_SIZE, tile % G::GRID_SIZE};
+            return true;
         }
     }
-    return true;
+    return false;
 }
 
-bool forwardCheckCol(int row, int col, vector<vector<Tile*>>& puzzle) {
-    int numBombs = 0;
-    int numEmptys = 0;
-    for (size_t r = 0; r < puzzle.size(); ++r) {
-        numBombs += (puzzle[r][col]->assignment == BOMB);
-        numEmptys += (puzzle[r][col]->assignment == EMPTY);
-    }
-    // Check if we are third bomb. If we are, remove canBeBomb from every other unassigned tile's domain
-    if (puzzle[row][col]->assignment == BOMB && numBombs == 3) {
-        for (size_t r = 0; r < puzzle[row].size(); ++r) {
-            if (r == row || puzzle[r][col]->num != 0 || puzzle[r][col]->assignment != UNASSIGNED) continue;
-            puzzle[r][col]->domain.canBeBomb = false;
-            if (!puzzle[r][col]->domain.canBeBomb && !puzzle[r][col]->domain.canBeEmpty) {
-                return false;
+template <typename G>
+bool subsetInference(Puzzle<G>& puzzle, Trail<G>& trail) {
+    STATS_TIME(subsets);
+    using Bits = typename G::Bits;
+    const Masks<G>& masks = MASKS<G>;
+    // the open tiles of a constraint and the bombs it still needs among them
+    struct Region {
+        Bits tiles;
+        int size;
+        int bombs;
+    };
+    Region regions[G::UNITS + G::CELLS];
+    // rules out the value a group of tiles cannot take when their bombs are known
+    bool settled = false;
+    auto settle = [&](const Bits& tiles, int size, int minBombs, int maxBombs) {
+        if (size == 0) return;
+        TrailField ruledOut = minBombs == size ? CAN_BE_EMPTY : maxBombs == 0 ? CAN_BE_BOMB : BOMBS;
+        if (ruledOut == BOMBS || !(tiles & trailedField(puzzle, ruledOut))) return;
+        STATS_COUNT(subsetSettled);
+        removeFromDomain(tiles, ruledOut, puzzle, trail);
+        settled = true;
+    };
+    while (true) {
+        Bits unassigned = unassignedTiles(puzzle);
+        int count = 0;
+        for (int unit = 0; unit < G::UNITS; ++unit) {
+            const ConstraintCounts& counts = puzzle.units[unit];
+            if (counts.unassigned > 0) {
+                regions[count++] = {masks.units[unit] & unassigned, counts.unassigned,
+                                    puzzle.bombsPerUnit - counts.bombs};
             }
         }
-    }
-    // We are the final empty allowed
-    if (puzzle[row][col]->assignment == EMPTY && numEmptys == 6) {
-        for (size_t r = 0; r < puzzle[row].size(); ++r) {
-            if (r == row || puzzle[r][col]->num != 0 || puzzle[r][col]->assignment != UNASSIGNED) continue;
-            puzzle[r][col]->domain.canBeEmpty = false;
-            if (!puzzle[r][col]->domain.canBeBomb && !puzzle[r][col]->domain.canBeEmpty) {
-                return false;
+        int unitCount = count;
+        Bits numbered = puzzle.numbered;
+        while (numbered) {
+            int tile = popLowestTile(numbered);
+            const ConstraintCounts& counts = puzzle.clues[tile];
+            if (counts.unassigned > 0) {
+                regions[count++] = {masks.neighbours[tile] & unassigned, counts.unassigned,
+                                    puzzle.nums[tile] - counts.bombs};
             }
         }
+        settled = false;
+        // every clue against the units and the clues before it
+        for (int first = unitCount; first < count; ++first) {
+            const Region& clue = regions[first];
+            for (int second = 0; second < first; ++second) {
+                const Region& other = regions[second];
+                Bits shared = clue.tiles & other.tiles;
+                if (!shared) continue;
+                int sharedSize = popcount(shared);
+                int clueOnly = clue.size - sharedSize;
+                int otherOnly = other.size - sharedSize;
+                int minShared = std::max({0, clue.bombs - clueOnly, other.bombs - otherOnly});
+                int maxShared = std::min({sharedSize, clue.bombs, other.bombs});
+                if (minShared > maxShared) return STATS_FAIL(clueFailures);
+                settle(shared, sharedSize, minShared, maxShared);
+                settle(clue.tiles & ~shared, clueOnly, clue.bombs - maxShared, clue.bombs - minShared);
+                settle(other.tiles & ~shared, otherOnly, other.bombs - maxShared, other.bombs - minShared);
+            }
+        }
+        if (!settled) return true;
+        PropagationQueue<G> queue;
+        if (!assignForcedTiles(puzzle, trail, queue) || !propagate(puzzle, trail, queue)) return false;
     }
-    return true;
 }
 
-bool forwardCheckBox(int row, int col, vector<vector<Tile*>>& puzzle) {
-    int numBombs = 0;
-    int numEmptys = 0;
-    // Check box
-    Pair startCoords = getStartCoordsFromBox(getBoxFromCoords(row, col));
-    for (size_t r = startCoords.row; r < startCoords.row + 3; ++r) {
-        for (size_t c = startCoords.col; c < startCoords.col + 3; ++c) {
-            // Tile has been checked by row and col
-            numBombs += (puzzle[r][c]->assignment == BOMB);
-            numEmptys += (puzzle[r][c]->assignment == EMPTY);
-        }
-    }
-    // We are the 3rd bomb in the box
-    if (puzzle[row][col]->assignment == BOMB && numBombs == 3) {
-        for (size_t r = startCoords.row; r < startCoords.row + 3; ++r) {
-            for (size_t c = startCoords.col; c < startCoords.col + 3; ++c) {
-                if (r == row && c == col) continue;
-                if (puzzle[r][c]->num != 0 || puzzle[r][c]->assignment != UNASSIGNED) continue;
-                puzzle[r][c]->domain.canBeBomb = false;
-                if (!puzzle[r][c]->domain.canBeBomb && !puzzle[r][c]->domain.canBeEmpty) {
-                    return false;
-                }
-            }
-        }
+template <typename G>
+ZobristKey stateKey(const Puzzle<G>& puzzle) {
+    auto unassigned = unassignedTiles(puzzle);
+    auto canBeBomb = puzzle.canBeBomb & unassigned;
+    auto canBeEmpty = puzzle.canBeEmpty & unassigned;
+    // each word goes through a splitmix64 step, whose output carries it into the next one
+    uint64_t mixed = 0;
+    for (int word = 0; word < G::Bits::WORDS; ++word) {
+        uint64_t state = mixed ^ canBeBomb.words[word];
+        mixed = splitMix64(state);
+        state = mixed ^ canBeEmpty.words[word];
+        mixed = splitMix64(state);
     }
+    uint64_t high = splitMix64(mixed);
+    return puzzle.hash ^ ((ZobristKey(high) << 64) | splitMix64(mixed));
+}
 
-    // We are the final empty
-    if (puzzle[row][col]->assignment == EMPTY && numEmptys == 6) {
-        for (size_t r = startCoords.row; r < startCoords.row + 3; ++r) {
-            for (size_t c = startCoords.col; c < startCoords.col; ++c) {
-                if (r == row && c == col) continue;
-                if (puzzle[r][c]->num != 0 || puzzle[r][c]->assignment != UNASSIGNED) continue;
-                puzzle[r][c]->domain.canBeBomb = false;
-                if (!puzzle[r][c]->domain.canBeBomb && !puzzle[r][c]->domain.canBeEmpty) {
-                    return false;
-                }
-            }
-        }
+template <typename G>
+bool isPuzzleComplete(const Puzzle<G>& puzzle) {
+    return !unassignedTiles(puzzle);
+}
+
+template <typename G>
+bool forwardCheckUnit(int unit, Puzzle<G>& puzzle, Trail<G>& trail) {
+    STATS_TIME(propagate);
+    const ConstraintCounts& counts = puzzle.units[unit];
+    // Forced tiles are assigned in batches, so a unit can overshoot before it gets checked
+    if (counts.bombs > puzzle.bombsPerUnit || counts.empties > puzzle.emptysPerUnit)
+        return STATS_FAIL(unitFailures[unit / G::GRID_SIZE]);
+    auto others = MASKS<G>.units[unit] & unassignedTiles(puzzle);
+    // All the bombs are placed, remove canBeBomb from every other unassigned tile's domain
+    if (counts.bombs == puzzle.bombsPerUnit) {
+        removeFromDomain(others, CAN_BE_BOMB, puzzle, trail);
+        if (others & ~puzzle.canBeEmpty) return STATS_FAIL(unitFailures[unit / G::GRID_SIZE]);
+    }
+    // All the empties are placed, every other unassigned tile has to be a bomb
+    if (counts.empties == puzzle.emptysPerUnit) {
+        removeFromDomain(others, CAN_BE_EMPTY, puzzle, trail);
+        if (others & ~puzzle.canBeBomb) return STATS_FAIL(unitFailures[unit / G::GRID_SIZE]);
     }
     return true;
 }
 
-bool forwardCheckNumberedTile(int row, int col, vector<vector<Tile*>>& puzzle) {
-    // if (row == 0 && col == 7) {
-    //     int x = 3;
-    //     int y = 4;
-    // }
-    // const char* currentStatus = puzzleStatus(puzzle).c_str();
-    int numBombs = 0;
-    int numEmptys = 0;
-    int maxEmptys = 8 - puzzle[row][col]->num;
-    for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
-        for (int colOffset = -1; colOffset < 2; ++colOffset) {
-            if (rowOffset == 0 && colOffset == 0) continue;
-            if (!isInGrid(row + rowOffset, col + colOffset) ||
-                puzzle[row + rowOffset][col + colOffset]->num != 0) {
-                maxEmptys--;
-                continue;
-            }
-            numBombs += puzzle[row + rowOffset][col + colOffset]->assignment == BOMB;
-            numEmptys += puzzle[row + rowOffset][col + colOffset]->assignment == EMPTY;
-        }
-    }
+template <typename G>
+bool forwardCheckRow(int row, Puzzle<G>& puzzle, Trail<G>& trail) {
+    return forwardCheckUnit(rowUnit<G>(row), puzzle, trail);
+}
+
+template <typename G>
+bool forwardCheckCol(int col, Puzzle<G>& puzzle, Trail<G>& trail) {
+    return forwardCheckUnit(colUnit<G>(col), puzzle, trail);
+}
+
+template <typename G>
+bool forwardCheckBox(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail) {
+    return forwardCheckUnit(boxUnit<G>(getBoxFromCoords<G>(row, col)), puzzle, trail);
+}
+
+template <typename G>
+bool forwardCheckNumberedTile(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail) {
+    STATS_TIME(propagate);
+    int tile = row * G::GRID_SIZE + col;
+    const ConstraintCounts& counts = puzzle.clues[tile];
+    auto unassigned = MASKS<G>.neighbours[tile] & unassignedTiles(puzzle) & ~puzzle.numbered;
+    int numBombs = counts.bombs;
+    int numEmptys = counts.empties;
+    int maxEmptys = counts.bombs + counts.empties + counts.unassigned - puzzle.nums[tile];
+    if (numBombs > puzzle.nums[tile] || numEmptys > maxEmptys) return STATS_FAIL(clueFailures);
     // Check if maxBombs allowed reached and if so, set everything around to cannotbebomb
-    if (numBombs == puzzle[row][col]->num) {
-        for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
-            for (int colOffset = -1; colOffset < 2; ++colOffset) {
-                if (rowOffset == 0 && colOffset == 0) continue;
-                int r = row + rowOffset;
-                int c = col + colOffset;
-                if (!isInGrid(r, c)) continue;
-                if (puzzle[r][c]->num != 0 || puzzle[r][c]->assignment != UNASSIGNED) continue;
-                puzzle[r][c]->domain.canBeBomb = false;
-                if (!puzzle[r][c]->domain.canBeBomb && !puzzle[r][c]->domain.canBeEmpty) {
-                    return false;
-                }
-            }
-        }
+    if (numBombs == puzzle.nums[tile]) {
+        removeFromDomain(unassigned, CAN_BE_BOMB, puzzle, trail);
+        if (unassigned & ~puzzle.canBeEmpty) return STATS_FAIL(clueFailures);
     }
     // Check if maxEmptys allowed reached and if so, set everything around to cannotBeEmpty
     if (numEmptys == maxEmptys) {
-        for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
-            for (int colOffset = -1; colOffset < 2; ++colOffset) {
-                if (rowOffset == 0 && colOffset == 0) continue;
-                int r = row + rowOffset;
-                int c = col + colOffset;
-                if (!isInGrid(r, c)) continue;
-                if (puzzle[r][c]->num != 0 || puzzle[r][c]->assignment != UNASSIGNED) continue;
-                puzzle[r][c]->domain.canBeEmpty = false;
-                if (!puzzle[r][c]->domain.canBeBomb && !puzzle[r][c]->domain.canBeEmpty) {
-                    return false;
-                }
-            }
-        }
+        removeFromDomain(unassigned, CAN_BE_EMPTY, puzzle, trail);
+        if (unassigned & ~puzzle.canBeBomb) return STATS_FAIL(clueFailures);
     }
     return true;
 }
 
-bool forwardCheckNumberedTiles(int row, int col, vector<vector<Tile*>>& puzzle) {
-    for (int rowOffset = -1; rowOffset < 2; ++rowOffset) {
-        for (int colOffset = -1; colOffset < 2; ++colOffset) {
-            if (rowOffset == 0 && colOffset == 0) continue;
-            if (!isInGrid(row + rowOffset, col + colOffset) || puzzle[row + rowOffset][col + colOffset]->num == 0)
-                continue;
-            // We are at a numbered tile
-            if (!forwardCheckNumberedTile(row + rowOffset, col + colOffset, puzzle)) return false;
-        }
+template <typename G>
+bool forwardCheckNumberedTiles(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail) {
+    auto numberedNeighbours = MASKS<G>.neighbours[row * G::GRID_SIZE + col] & puzzle.numbered;
+    while (numberedNeighbours) {
+        int tile = popLowestTile(numberedNeighbours);
+        // We are at a numbered tile
+        if (!forwardCheckNumberedTile(tile / G::GRID_SIZE, tile % G::GRID_SIZE, puzzle, trail)) return false;
     }
     return true;
 }
 
-bool forwardChecking(int row, int col, vector<vector<Tile*>>& puzzle) {
-    // Fail-safe in case forwardChecking ends with a failure.
-    vector<vector<Tile>> copy = makeCopy(puzzle);
-    if (forwardCheckRow(row, col, puzzle) && forwardCheckCol(row, col, puzzle) &&
-        forwardCheckBox(row, col, puzzle) && forwardCheckNumberedTiles(row, col, puzzle))
-        return true;
-    copyPuzzle(puzzle, copy);
-    return false;
+template <typename G>
+bool forwardChecking(int row, int col, Puzzle<G>& puzzle, Trail<G>& trail) {
+    PropagationQueue<G> queue;
+    queue.tiles[queue.tail++] = row * G::GRID_SIZE + col;
+    return propagate(puzzle, trail, queue);
 }
 
-Pair getCoordsOfTile(const Tile* tile, vector<vector<Tile*>> puzzle) {
-    for (int row = 0; row < puzzle.size(); ++row) {
-        for (int col = 0; col < puzzle.size(); ++col) {
-            if (tile == puzzle[row][col]) return Pair{row, col};
-        }
+template <typename G>
+bool initialInference(Puzzle<G>& puzzle, Trail<G>& trail) {
+    for (int unit = 0; unit < G::UNITS; ++unit) {
+        if (!forwardCheckUnit(unit, puzzle, trail)) return false;
     }
-    return Pair{0, 0};
+    auto numbered = puzzle.numbered;
+    while (numbered) {
+        int tile = popLowestTile(numbered);
+        if (!forwardCheckNumberedTile(tile / G::GRID_SIZE, tile % G::GRID_SIZE, puzzle, trail)) return false;
+    }
+    PropagationQueue<G> queue;
+    return assignForcedTiles(puzzle, trail, queue) && propagate(puzzle, trail, queue);
 }
 
-void writeAnswer(vector<vector<Tile*>>& puzzle, unordered_set<string>& nodes) {
-    ofstream outputFile("output.txt");
-    outputFile << getGoalDepth(puzzle) << endl;
-    outputFile << nodes.size() << endl;
-    for (size_t row = 0; row < puzzle.size(); ++row) {
-        for (size_t col = 0; col < puzzle[row].size(); ++col) {
-            outputFile << (puzzle[row][col]->assignment == BOMB) << " ";
-            delete puzzle[row][col];
-        }
-        outputFile << endl;
+template <typename G>
+bool assignForcedTiles(Puzzle<G>& puzzle, Trail<G>& trail, PropagationQueue<G>& queue) {
+    auto unassigned = unassignedTiles(puzzle);
+    if (unassigned & ~(puzzle.canBeBomb | puzzle.canBeEmpty)) return STATS_FAIL(domainFailures);
+    auto forced = unassigned & (puzzle.canBeBomb ^ puzzle.canBeEmpty);
+    while (forced) {
+        int tile = popLowestTile(forced);
+        STATS_COUNT(forcedAssignments);
+        Assignment value = puzzle.canBeBomb.test(tile) ? BOMB : EMPTY;
+        assignTile(tile / G::GRID_SIZE, tile % G::GRID_SIZE, value, puzzle, trail);
+        queue.tiles[queue.tail++] = tile;
     }
+    return true;
 }
 
-vector<vector<Tile>> makeCopy(vector<vector<Tile*>>& puzzle) {
-    vector<vector<Tile>> copy(puzzle.size(), vector<Tile>(puzzle[0].size()));
-    for (size_t row = 0; row < puzzle.size(); ++row) {
-        for (size_t col = 0; col < puzzle[row].size(); ++col) {
-            copy[row][col] = *puzzle[row][col];
-        }
+template <typename G>
+bool propagate(Puzzle<G>& puzzle, Trail<G>& trail, PropagationQueue<G>& queue) {
+    while (queue.head < queue.tail) {
+        int tile = queue.tiles[queue.head++];
+        int row = tile / G::GRID_SIZE;
+        int col = tile % G::GRID_SIZE;
+        if (!forwardCheckRow(row, puzzle, trail) || !forwardCheckCol(col, puzzle, trail) ||
+            !forwardCheckBox(row, col, puzzle, trail) || !forwardCheckNumberedTiles(row, col, puzzle, trail))
+            return false;
+        if (!assignForcedTiles(puzzle, trail, queue)) return false;
+    }
+    return true;
+}
+
+template <typename G>
+bool cdclSearch(Puzzle<G>& puzzle, size_t& nodes, SearchControl* control) {
+    const Masks<G>& masks = MASKS<G>;
+    vector<int> variables(G::CELLS, -1);
+    vector<int> tiles;
+    auto blank = G::ALL_TILES & ~puzzle.numbered;
+    while (blank) {
+        int tile = popLowestTile(blank);
+        variables[tile] = tiles.size();
+        tiles.push_back(tile);
+    }
+    CdclSolver solver(tiles.size());
+    // the tiles of a constraint that are still unassigned, and how many of them have to be bombs
+    auto addConstraint = [&](const typename G::Bits& members, int bombs) {
+        vector<int> constraintVariables;
+        auto unassigned = members & unassignedTiles(puzzle);
+        while (unassigned) constraintVariables.push_back(variables[popLowestTile(unassigned)]);
+        solver.addExactly(constraintVariables, bombs - popcount(members & puzzle.bombs));
+    };
+    for (int unit = 0; unit < G::UNITS; ++unit) addConstraint(masks.units[unit], puzzle.bombsPerUnit);
+    auto numbered = puzzle.numbered;
+    while (numbered) {
+        int tile = popLowestTile(numbered);
+        addConstraint(masks.neighbours[tile] & ~puzzle.numbered, puzzle.nums[tile]);
+    }
+    for (int variable = 0; variable < int(tiles.size()); ++variable) {
+        int tile = tiles[variable];
+        if (!(unassignedTiles(puzzle) & G::Bits::bit(tile))) solver.fix(variable, puzzle.bombs.test(tile));
     }
-    return copy;
+    bool solved = solver.solve(control);
+    nodes += solver.decisions();
+    if (!solved) return false;
+    std::unique_ptr<Trail<G>> trail(new Trail<G>());
+    for (int variable = 0; variable < int(tiles.size()); ++variable) {
+        int tile = tiles[variable];
+        if (!(unassignedTiles(puzzle) & G::Bits::bit(tile))) continue;
+        assignTile(tile / G::GRID_SIZE, tile % G::GRID_SIZE, solver.value(variable) ? BOMB : EMPTY, puzzle, *trail);
+    }
+    return true;
 }
-void copyPuzzle(vector<vector<Tile*>>& puzzle, vector<vector<Tile>>& copy) {
-    for (size_t row = 0; row < puzzle.size(); ++row) {
-        for (size_t col = 0; col < puzzle[row].size(); ++col) {
-            *puzzle[row][col] = copy[row][col];
+
+#ifndef SOLVER_LIBRARY
+template <typename G>
+string formatAnswer(const Puzzle<G>& puzzle, size_t nodes, int status) {
+    string result = std::to_string(getGoalDepth(puzzle)) + "\n" + std::to_string(nodes) + "\n";
+    // the grid is a fixed size, so it is filled in place rather than appended to
+    size_t start = result.size();
+    result.resize(start + G::CELLS * 2 + G::GRID_SIZE);
+    char* text = &result[start];
+    for (int row = 0; row < G::GRID_SIZE; ++row) {
+        for (int col = 0; col < G::GRID_SIZE; ++col) {
+            *text++ = puzzle.bombs.test(row * G::GRID_SIZE + col) ? '1' : '0';
+            *text++ = ' ';
         }
+        *text++ = '\n';
+    }
+    if (status == SOLVER_UNSOLVABLE) result += "unsolvable\n";
+    if (status == SOLVER_GAVE_UP) result += "gaveup\n";
+    return result;
+}
+
+template <typename G>
+string packAnswer(const Puzzle<G>& puzzle, size_t nodes, int status) {
+    string record(12 + (G::CELLS + 7) / 8, '\0');
+    int goalDepth = getGoalDepth(puzzle);
+    record[0] = char(status);
+    record[1] = G::GRID_SIZE;
+    record[2] = char(goalDepth);
+    record[3] = char(goalDepth >> 8);
+    for (int byte = 0; byte < 8; ++byte) record[4 + byte] = char(uint64_t(nodes) >> (8 * byte));
+    auto bombs = puzzle.bombs;
+    while (bombs) {
+        int tile = popLowestTile(bombs);
+        record[12 + tile / 8] |= char(1 << (tile % 8));
     }
+    return record;
 }
-string puzzleStatus(const vector<vector<Tile*>>& puzzle) {
+
+template <typename G>
+string puzzleStatus(const Puzzle<G>& puzzle) {
     string result = "";
-    for (size_t row = 0; row < puzzle.size(); ++row) {
-        for (size_t col = 0; col < puzzle.size(); ++col) {
-            if (puzzle[row][col]->num != 0)
-                result += std::to_string(puzzle[row][col]->num);
-            else if (puzzle[row][col]->assignment == BOMB)
+    for (int row = 0; row < G::GRID_SIZE; ++row) {
+        for (int col = 0; col < G::GRID_SIZE; ++col) {
+            int tile = row * G::GRID_SIZE + col;
+            if (puzzle.numbered.test(tile))
+                result += std::to_string(puzzle.nums[tile]);
+            else if (puzzle.bombs.test(tile))
                 result += "B";
-            else if (puzzle[row][col]->assignment == EMPTY)
+            else if (puzzle.empties.test(tile))
                 result += "E";
             else
                 result += "0";
@@ -610,20 +4052,73 @@ string puzzleStatus(const vector<vector<Tile*>>& puzzle) {
     }
     return result;
 }
+#endif
 
-// I didn't want to use puzzleStatus to make the keys because puzzleStatus is supposed to be a testing only
-// function, so it would look weird.
-string makeKey(const vector<vector<Tile*>>& puzzle) {
-    return puzzleStatus(puzzle);
+// Gets the goal depth of the puzzle by counting how many 0s
+template <typename G>
+int getGoalDepth(const Puzzle<G>& puzzle) {
+    return G::CELLS - popcount(puzzle.numbered);
 }
 
-// Gets the goal depth of the puzzle by counting how many 0s
-int getGoalDepth(const vector<vector<Tile*>>& puzzle) {
-    int res = 0;
-    for (size_t row = 0; row < puzzle.size(); ++row) {
-        for (size_t col = 0; col < puzzle.size(); ++col) {
-            if (puzzle[row][col]->num == 0) res++;
-        }
+#ifdef SOLVER_STATS
+std::mutex statsMutex;
+SolverStats totalStats;
+
+void mergeStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    PhaseStats SolverStats::*phases[] = {&SolverStats::select, &SolverStats::propagate, &SolverStats::assign,
+                                         &SolverStats::undo,   &SolverStats::hash,      &SolverStats::io,
+                                         &SolverStats::subsets};
+    for (PhaseStats SolverStats::*phase : phases) {
+        (totalStats.*phase).calls += (solverStats.*phase).calls;
+        (totalStats.*phase).nanoseconds += (solverStats.*phase).nanoseconds;
     }
-    return res;
+    totalStats.decisions += solverStats.decisions;
+    totalStats.backtracks += solverStats.backtracks;
+    totalStats.forcedAssignments += solverStats.forcedAssignments;
+    totalStats.subsetSettled += solverStats.subsetSettled;
+    totalStats.refutationProbes += solverStats.refutationProbes;
+    totalStats.refutationHits += solverStats.refutationHits;
+    totalStats.maxDepth = std::max(totalStats.maxDepth, solverStats.maxDepth);
+    for (int type = 0; type < 3; ++type) totalStats.unitFailures[type] += solverStats.unitFailures[type];
+    totalStats.clueFailures += solverStats.clueFailures;
+    totalStats.domainFailures += solverStats.domainFailures;
+    totalStats.conflicts += solverStats.conflicts;
+    solverStats = SolverStats();
 }
+
+void writeStats(const string& statsPath) {
+    // whatever the main thread did outside of the workers, reading and writing included
+    mergeStats();
+    const SolverStats& stats = totalStats;
+    std::ostringstream results;
+    results << std::fixed << std::setprecision(3);
+    results << "{\n";
+    results << "  \"phases\": {";
+    std::pair<const char*, const PhaseStats*> phases[] = {{"select", &stats.select}, {"propagate", &stats.propagate},
+                                                          {"assign", &stats.assign}, {"undo", &stats.undo},
+                                                          {"hash", &stats.hash},     {"io", &stats.io},
+                                                          {"subsets", &stats.subsets}};
+    for (size_t phase = 0; phase < std::size(phases); ++phase) {
+        results << (phase > 0 ? "," : "") << "\n    \"" << phases[phase].first << "\": {\"calls\": "
+                << phases[phase].second->calls << ", \"ms\": " << phases[phase].second->nanoseconds / 1e6 << "}";
+    }
+    results << "\n  },\n";
+    results << "  \"decisions\": " << stats.decisions << ",\n";
+    results << "  \"backtracks\": " << stats.backtracks << ",\n";
+    results << "  \"max_depth\": " << stats.maxDepth << ",\n";
+    results << "  \"forced_assignments\": " << stats.forcedAssignments << ",\n";
+    results << "  \"subset_settled\": " << stats.subsetSettled << ",\n";
+    results << "  \"refutations\": {\"probes\": " << stats.refutationProbes << ", \"hits\": " << stats.refutationHits
+            << "},\n";
+    results << "  \"failures\": {\"row\": " << stats.unitFailures[0] << ", \"column\": " << stats.unitFailures[1]
+            << ", \"box\": " << stats.unitFailures[2] << ", \"clue\": " << stats.clueFailures
+            << ", \"domain\": " << stats.domainFailures << "},\n";
+    results << "  \"cdcl_conflicts\": " << stats.conflicts << "\n";
+    results << "}\n";
+    ofstream statsFile(statsPath);
+    statsFile << results.str();
+}
+#endif
+
+} // namespace
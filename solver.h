@@ -0,0 +1,85 @@
+// Library interface of the Sudoku Mine solver, built by make lib into libsolver.a and libsolver.so. The same
+// solver runs behind the solve.o command line; this header is all a service needs to link against it.
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdint.h>
+
+#define SOLVER_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Outcome of one solve
+enum SolverStatus { SOLVER_INVALID = -1, SOLVER_UNSOLVABLE = 0, SOLVER_SOLVED = 1, SOLVER_GAVE_UP = 2 };
+
+// Edits of a loaded puzzle, see Solver::edit
+enum SolverEdit { SOLVER_CLEAR = 0, SOLVER_CLUE = 1, SOLVER_PIN_BOMB = 2, SOLVER_PIN_EMPTY = 3 };
+
+typedef struct SolverConfig {
+    int bombsPerUnit;    // 0 picks the default for the grid size
+    int countAllNodes;   // nonzero counts every assignment, otherwise only distinct formations are counted
+    int cdcl;            // nonzero uses the CDCL engine, which builds its clause database anew on every solve
+    uint64_t nodeBudget; // nodes a solve may generate before it gives up, 0 for no limit
+    int deadlineMs;      // milliseconds a solve may take before it gives up, 0 for no limit
+} SolverConfig;
+
+typedef struct SolverResult {
+    int status;     // a SolverStatus
+    int goalDepth;  // blank tiles the search had to fill
+    uint64_t nodes; // nodes generated, counted the same way as on the command line
+} SolverResult;
+
+// C interface over a Solver object. A handle must only be used by one thread at a time.
+typedef struct SolverHandle SolverHandle;
+
+// config may be null for the defaults. Returns null if out of memory.
+SOLVER_API SolverHandle* solverCreate(const SolverConfig* config);
+SOLVER_API void solverDestroy(SolverHandle* solver);
+// Same as Solver::solve, returns the SolverStatus
+SOLVER_API int solverSolve(SolverHandle* solver, const uint8_t* values, int gridSize, uint8_t* bombs,
+                           SolverResult* result);
+// Same as Solver::load and Solver::edit, return the SolverStatus
+SOLVER_API int solverLoad(SolverHandle* solver, const uint8_t* values, int gridSize, uint8_t* bombs,
+                          SolverResult* result);
+SOLVER_API int solverEdit(SolverHandle* solver, int tile, int edit, int number, uint8_t* bombs, SolverResult* result);
+
+#ifdef __cplusplus
+}
+
+#include <memory>
+
+// Solves 9x9, 16x16 and 25x25 puzzles. All the scratch state of a solve lives in an arena owned by the object,
+// which only grows when it meets a bigger board than before, so repeated solves with the backtracking engine make
+// no heap allocations once the object is warm. Not thread safe, give every thread its own Solver.
+class SOLVER_API Solver {
+public:
+    explicit Solver(const SolverConfig& config = SolverConfig());
+    ~Solver();
+    Solver(Solver&& other) noexcept;
+    Solver& operator=(Solver&& other) noexcept;
+
+    // Solves a puzzle of gridSize * gridSize tile values in row-major order, 0 for a blank tile and 1-8 for a
+    // numbered one. bombs receives one byte per tile, 1 for a bomb. Returns true if a solution was found; the
+    // result tells an unsolvable puzzle from an invalid one or one the solver gave up on. Without a solution, bombs
+    // only holds the bombs inference placed, never the guesses of an unfinished search.
+    bool solve(const uint8_t* values, int gridSize, uint8_t* bombs, SolverResult& result);
+
+    // Solves a puzzle the same way and keeps it loaded for edit, until the next load or solve.
+    bool load(const uint8_t* values, int gridSize, uint8_t* bombs, SolverResult& result);
+    // Changes one tile of the loaded puzzle and answers it again, with bombs and result as for solve. SOLVER_CLUE
+    // numbers the tile with number, SOLVER_PIN_BOMB and SOLVER_PIN_EMPTY fix its value and SOLVER_CLEAR makes it a
+    // free blank tile. The answer starts from the last one: a solution the edit keeps is returned with 0 nodes, as is
+    // an unsolvable puzzle that only gained constraints, and otherwise the search starts from what inference knew
+    // before the edit, if the edit took no constraint away, and tries the value of the last solution first. Returns
+    // false with SOLVER_INVALID and the puzzle unchanged for a bad edit or when no puzzle is loaded.
+    bool edit(int tile, int edit, int number, uint8_t* bombs, SolverResult& result);
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+#endif
+
+#endif
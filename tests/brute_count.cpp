@@ -0,0 +1,80 @@
+// Counts the solutions of every puzzle in a file by trying every way to place the bombs of each row in turn, one
+// count per line. make check compares these with the counts of ./solve.o --count, so keep the puzzles small.
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "check.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+struct BruteForce {
+    const CheckPuzzle& puzzle;
+    int bombsPerUnit;
+    int size;
+    int boxSize;
+    vector<uint8_t> bombs;
+    vector<int> cols;
+    vector<int> boxes;
+    uint64_t count = 0;
+
+    BruteForce(const CheckPuzzle& puzzle, int bombsPerUnit)
+        : puzzle(puzzle), bombsPerUnit(bombsPerUnit), size(puzzle.gridSize),
+          boxSize(int(std::lround(std::sqrt(size)))), bombs(size * size), cols(size), boxes(size) {}
+
+    // true if every numbered tile of a row has the right number of bombs around it, once its neighbours are placed
+    bool rowClues(int row) const {
+        if (row < 0) return true;
+        for (int col = 0; col < size; ++col) {
+            int tile = row * size + col;
+            if (puzzle.values[tile] && bombsAround(bombs.data(), size, tile) != puzzle.values[tile]) return false;
+        }
+        return true;
+    }
+
+    void placeRow(int row) {
+        if (row == size) {
+            if (isSolution(puzzle, bombsPerUnit, bombs.data())) ++count;
+            return;
+        }
+        for (uint32_t mask = 0; mask < (uint32_t(1) << size); ++mask) {
+            if (__builtin_popcount(mask) != bombsPerUnit) continue;
+            vector<int> placed;
+            bool fits = true;
+            for (int col = 0; col < size && fits; ++col) {
+                if (!(mask >> col & 1)) continue;
+                int box = row / boxSize * boxSize + col / boxSize;
+                fits = puzzle.values[row * size + col] == 0 && cols[col] < bombsPerUnit && boxes[box] < bombsPerUnit;
+                if (!fits) break;
+                ++cols[col];
+                ++boxes[box];
+                bombs[row * size + col] = 1;
+                placed.push_back(col);
+            }
+            if (fits && rowClues(row - 1)) placeRow(row + 1);
+            for (int col : placed) {
+                --cols[col];
+                --boxes[row / boxSize * boxSize + col / boxSize];
+                bombs[row * size + col] = 0;
+            }
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    vector<CheckPuzzle> puzzles;
+    if (argc != 2 || !readCheckPuzzles(argv[1], puzzles)) {
+        cout << "Run ./brute_count.o puzzles.txt" << endl;
+        return 1;
+    }
+    for (const CheckPuzzle& puzzle : puzzles) {
+        BruteForce search(puzzle, defaultBombsPerUnit(puzzle.gridSize));
+        search.placeRow(0);
+        cout << search.count << endl;
+    }
+    return 0;
+}
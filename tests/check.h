@@ -0,0 +1,88 @@
+// Helpers shared by the programs make check builds. They read puzzles and check answers without any of the
+// solver's code, so that a bug there cannot hide itself.
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct CheckPuzzle {
+    int gridSize = 0;
+    std::vector<uint8_t> values; // row-major, 0 for a blank tile and 1-8 for a numbered one
+};
+
+// Reads every puzzle in a file of the solver's text format: rows of values, puzzles separated by blank lines and
+// lines starting with # skipped. Returns false if the file cannot be opened.
+inline bool readCheckPuzzles(const std::string& filePath, std::vector<CheckPuzzle>& puzzles) {
+    std::ifstream file(filePath);
+    if (!file) return false;
+    CheckPuzzle puzzle;
+    std::string line;
+    auto finish = [&]() {
+        if (!puzzle.values.empty()) puzzles.push_back(puzzle);
+        puzzle = CheckPuzzle();
+    };
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            finish();
+            continue;
+        }
+        std::istringstream row(line);
+        int value;
+        int count = 0;
+        while (row >> value) {
+            puzzle.values.push_back(value);
+            ++count;
+        }
+        if (puzzle.gridSize == 0) puzzle.gridSize = count;
+    }
+    finish();
+    return true;
+}
+
+inline int defaultBombsPerUnit(int gridSize) {
+    return gridSize / 3;
+}
+
+// number of bombs among the 8 neighbours of a tile
+inline int bombsAround(const uint8_t* bombs, int gridSize, int tile) {
+    int row = tile / gridSize;
+    int col = tile % gridSize;
+    int count = 0;
+    for (int r = std::max(row - 1, 0); r <= std::min(row + 1, gridSize - 1); ++r) {
+        for (int c = std::max(col - 1, 0); c <= std::min(col + 1, gridSize - 1); ++c) {
+            if (r != row || c != col) count += bombs[r * gridSize + c];
+        }
+    }
+    return count;
+}
+
+// true if bombs, one byte per tile, has bombsPerUnit bombs in every row, column and box, none on a numbered tile
+// and the right number around every numbered tile
+inline bool isSolution(const CheckPuzzle& puzzle, int bombsPerUnit, const uint8_t* bombs) {
+    int size = puzzle.gridSize;
+    int boxSize = int(std::lround(std::sqrt(size)));
+    for (int unit = 0; unit < size; ++unit) {
+        int row = 0;
+        int col = 0;
+        int box = 0;
+        for (int i = 0; i < size; ++i) {
+            row += bombs[unit * size + i];
+            col += bombs[i * size + unit];
+            box += bombs[(unit / boxSize * boxSize + i / boxSize) * size + unit % boxSize * boxSize + i % boxSize];
+        }
+        if (row != bombsPerUnit || col != bombsPerUnit || box != bombsPerUnit) return false;
+    }
+    for (int tile = 0; tile < size * size; ++tile) {
+        if (puzzle.values[tile] == 0) continue;
+        if (bombs[tile] || bombsAround(bombs, size, tile) != puzzle.values[tile]) return false;
+    }
+    return true;
+}
+
+#endif
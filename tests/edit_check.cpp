@@ -0,0 +1,93 @@
+// Loads every puzzle of the files given into a Solver and makes random edits to it, the kind a player makes: revealing
+// the number on a tile, flagging a bomb, pinning a tile as empty, clearing a tile again, and now and then a wrong
+// edit. After each one the answer must match a fresh Solver given the same tiles, and a solution must keep every
+// number and pin. Built against libsolver.a by make check.
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../solver.h"
+#include "check.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// edits made to each puzzle
+constexpr int EDITS = 40;
+
+// true if bombs has a bomb on every tile pinned as one and none on a tile pinned as empty
+bool keepsPins(const vector<uint8_t>& pins, const vector<uint8_t>& bombs) {
+    for (size_t tile = 0; tile < pins.size(); ++tile) {
+        if ((pins[tile] == SOLVER_PIN_BOMB && !bombs[tile]) || (pins[tile] == SOLVER_PIN_EMPTY && bombs[tile])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "Run ./edit_check.o puzzles.txt..." << endl;
+        return 1;
+    }
+    std::mt19937_64 random(7);
+    size_t edits = 0;
+    for (int arg = 1; arg < argc; ++arg) {
+        vector<CheckPuzzle> puzzles;
+        if (!readCheckPuzzles(argv[arg], puzzles)) {
+            cout << "Cannot read " << argv[arg] << endl;
+            return 1;
+        }
+        for (size_t index = 0; index < puzzles.size(); ++index) {
+            CheckPuzzle puzzle = puzzles[index];
+            int size = puzzle.gridSize;
+            int tiles = size * size;
+            SolverConfig config = {defaultBombsPerUnit(size), 0, 0, 0, 0};
+            Solver solver(config);
+            vector<uint8_t> bombs(tiles), truth(tiles), pins(tiles), fresh(tiles);
+            SolverResult result;
+            if (!solver.load(puzzle.values.data(), size, bombs.data(), result)) continue;
+            truth = bombs;
+            for (int edit = 0; edit < EDITS; ++edit) {
+                int tile = random() % tiles;
+                int kind = SOLVER_CLEAR;
+                int number = 0;
+                int roll = random() % 10;
+                if (roll < 6) {
+                    // what the player sees on revealing a tile, or the bomb they flag
+                    number = bombsAround(truth.data(), size, tile);
+                    kind = truth[tile] ? SOLVER_PIN_BOMB : roll < 4 && number > 0 ? SOLVER_CLUE : SOLVER_PIN_EMPTY;
+                } else if (roll == 9) {
+                    kind = random() % 4;
+                    number = 1 + random() % 8;
+                }
+                if (kind != SOLVER_CLUE) number = 0;
+                bool applied = solver.edit(tile, kind, number, bombs.data(), result);
+                puzzle.values[tile] = number;
+                pins[tile] = kind == SOLVER_PIN_BOMB || kind == SOLVER_PIN_EMPTY ? kind : 0;
+                // a fresh solver gets the same tiles, with the pins as the only edits
+                Solver reference(config);
+                SolverResult expected;
+                reference.load(puzzle.values.data(), size, fresh.data(), expected);
+                for (int pinned = 0; pinned < tiles; ++pinned) {
+                    if (pins[pinned]) reference.edit(pinned, pins[pinned], 0, fresh.data(), expected);
+                }
+                ++edits;
+                bool solutionBroken = applied && result.status == SOLVER_SOLVED &&
+                                      !(isSolution(puzzle, config.bombsPerUnit, bombs.data()) && keepsPins(pins, bombs));
+                if (result.status != expected.status || solutionBroken) {
+                    cout << "Puzzle " << index + 1 << " of " << argv[arg] << ", edit " << edit + 1 << " (" << kind
+                         << " on tile " << tile << "): status " << result.status << " but a fresh solve gives "
+                         << expected.status << (solutionBroken ? ", and the solution breaks a rule" : "") << endl;
+                    return 1;
+                }
+            }
+        }
+    }
+    cout << edits << " edits match a fresh solve" << endl;
+    return 0;
+}